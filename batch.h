@@ -0,0 +1,85 @@
+#ifndef WSUN_SOKOBAN_BATCH_H
+#define WSUN_SOKOBAN_BATCH_H
+
+#include "solver.h"
+#include "solutioncache.h"
+#include "threadpool.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// "all", "5" 或 "1-90"
+static bool parseRange(const char* str, int& first, int& last) {
+  if (strcmp(str, "all") == 0) {
+    first = 1;
+    last = INT_MAX;
+    return true;
+  }
+  char* end = nullptr;
+  first = static_cast<int>(strtol(str, &end, 10));
+  last = first;
+  if (*end == '-') last = static_cast<int>(strtol(end + 1, &end, 10));
+  return *end == '\0' && first > 0 && first <= last;
+}
+
+// 每个关卡一行 JSON, 方便夜间批量跑完之后用脚本汇总
+static void printLevelReport(FILE* out, int level, const SearchResult& result) {
+  fprintf(out, "{\"level\": %d, \"status\": \"%s\", \"solved\": %s, \"cached\": %s, \"pushes\": %zu, \"moves\": %zu, "
+      "\"generated\": %lu, \"expanded\": %lu, \"frozen\": %lu, \"pattern\": %lu, \"corral\": %lu, \"time_ms\": %lu, \"peak_memory_bytes\": %zu}\n",
+      level, statusName(result.status), result.solved() ? "true" : "false", result.cached ? "true" : "false",
+      result.pushes.size(), result.moves.size(), result.generateNodes, result.explorNodes,
+      result.frozenNodes, result.patternNodes, result.corralNodes, result.timeMs, result.peakMemoryBytes);
+}
+
+// 在线程池上并发求解 [first, last] 范围内的关卡(从1开始编号), 结果按关卡顺序输出.
+// 给了 cache 时先查缓存, 命中的关卡不再搜索, 新解出的关卡存进去
+static void solveBatch(const LevelArray& levels, int first, int last, int threads,
+    const SearchOptions& options, FILE* out, SolutionCache* cache = nullptr) {
+  first = std::max(first, 1);
+  last = std::min(last, static_cast<int>(levels.size()));
+  if (first > last) return;
+
+  // -t 和 -M 给的是整个批量的预算, 同时在跑的关卡平分
+  size_t workers = std::min(threads, last - first + 1);
+  SearchOptions levelOptions = options;
+  levelOptions.verbose = false;
+  levelOptions.transpositionBytes = options.transpositionBytes / workers;
+  if (options.memoryLimitBytes != 0) {
+    levelOptions.memoryLimitBytes = options.memoryLimitBytes / workers;
+    levelOptions.transpositionBytes = std::min(levelOptions.transpositionBytes, levelOptions.memoryLimitBytes / 2);
+  }
+
+  uint64_t startTime = getNowTime();
+  std::vector<SearchResult> results(last - first + 1);
+  {
+    WorkStealingPool pool(threads);
+    for (int level = first; level <= last; ++level) {
+      pool.submit([&levels, &results, &levelOptions, cache, first, level] {
+        if (const char* error = levelError(levels[level - 1])) {
+          fprintf(stderr, "skip level %d: %s\n", level, error);
+          return;
+        }
+        Board board(levels[level - 1]);
+        SearchResult& result = results[level - first];
+        if (cache != nullptr && cache->lookup(board, result)) return;
+        const Board start(board);
+        result = astarSearch(board, levelOptions);
+        if (cache != nullptr) cache->store(start, result);
+      });
+    }
+    pool.wait();
+  }
+
+  int solved = 0;
+  int cached = 0;
+  for (int level = first; level <= last; ++level) {
+    const SearchResult& result = results[level - first];
+    if (result.solved()) ++solved;
+    if (result.cached) ++cached;
+    printLevelReport(out, level, result);
+  }
+  fprintf(stderr, "solved %d/%d levels (%d from cache) with %d threads in %lu ms\n",
+      solved, last - first + 1, cached, threads, (getNowTime() - startTime) / 1000000);
+}
+
+#endif
@@ -0,0 +1,297 @@
+// 基准测试: 在固定限制下把 screens/ 里选定的关卡各跑若干次, 每个关卡输出一行 JSON
+// (JSON Lines 格式, 一行一个对象, 整个文件不是一个 JSON 文档, 所以用 .jsonl 后缀),
+// 并可以和保存的基线比较, 超过阈值的退化打印出来并以非0退出, 用来卡每次求解器改动.
+//
+// 编译: make bench (和 sokoban 本体链接 Makefile 里同一组源文件)
+// 用法:
+//   ./bench -l 1-10 -r 5 -T 30 -o current.jsonl
+//   ./bench -l 1-10 -r 5 -T 30 -B baseline.jsonl -R 10
+
+#include "parser.h"
+#include "solver.h"
+#include "batch.h"
+#include "parallel.h"
+#include "ida.h"
+#include "bidirectional.h"
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+enum class Mode { kAstar, kIda, kParallel, kBidirectional };
+
+// 子进程通过管道交回的一次运行结果
+struct Sample {
+  int solved;
+  uint64_t pushes;
+  uint64_t expanded;
+  uint64_t elapsedUs;
+  // 由父进程从 wait4 取得, 单位 KB
+  long peakRssKb;
+};
+
+struct LevelReport {
+  int level = 0;
+  bool solved = false;
+  uint64_t pushes = 0;
+  uint64_t expanded = 0;
+  double medianMs = 0;
+  double nodesPerSec = 0;
+  long peakRssKb = 0;
+};
+
+struct Config {
+  int first = 1;
+  int last = 10;
+  int repeats = 3;
+  int threads = 4;
+  Mode mode = Mode::kAstar;
+  SearchOptions options;
+  const char* outputPath = nullptr;
+  const char* baselinePath = nullptr;
+  // 百分比
+  double threshold = 10;
+  // 比这个还快的关卡时间抖动太大, 只比较节点数
+  double minComparableMs = 20;
+};
+
+void usage(const char* name) {
+  printf("usage: %s [-l all|first[-last]] [-r repeats] [-T seconds] [-M mb] [-t transposition_mb]\n"
+         "          [-m astar|ida|parallel|bidir] [-j threads] [-o output.jsonl]\n"
+         "          [-B baseline.jsonl] [-R threshold_percent]\n"
+         "output and baseline are JSON Lines: one JSON object per level per line\n", name);
+}
+
+SearchResult solve(const Level& level, const Config& config) {
+  Board board(level);
+  switch (config.mode) {
+    case Mode::kIda: return idaSearch(board, config.options);
+    case Mode::kParallel: return parallelAstarSearch(board, config.threads, config.options);
+    case Mode::kBidirectional: return bidirectionalSearch(board, config.options);
+    default: return astarSearch(board, config.options);
+  }
+}
+
+// 每次运行放在单独的子进程里, 这样 ru_maxrss 就是这一次运行的内存峰值, 互不影响
+bool runOnce(const Level& level, const Config& config, Sample& sample) {
+  int fds[2];
+  if (pipe(fds) != 0) return false;
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    auto begin = std::chrono::steady_clock::now();
+    SearchResult result = solve(level, config);
+    auto end = std::chrono::steady_clock::now();
+    Sample child{ result.solved() ? 1 : 0, result.pushes.size(), result.explorNodes,
+      static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()), 0 };
+    ssize_t written = write(fds[1], &child, sizeof(child));
+    _exit(written == sizeof(child) ? 0 : 1);
+  }
+  close(fds[1]);
+  ssize_t got = read(fds[0], &sample, sizeof(sample));
+  close(fds[0]);
+  int status = 0;
+  struct rusage resources;
+  if (wait4(pid, &status, 0, &resources) != pid) return false;
+  sample.peakRssKb = resources.ru_maxrss;
+  return got == sizeof(sample) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+bool benchLevel(const Level& level, int index, const Config& config, LevelReport& report) {
+  std::vector<Sample> samples;
+  for (int i = 0; i < config.repeats; ++i) {
+    Sample sample;
+    if (!runOnce(level, config, sample)) return false;
+    samples.push_back(sample);
+  }
+  std::sort(samples.begin(), samples.end(), [](const Sample& l, const Sample& r) {
+    return l.elapsedUs < r.elapsedUs;
+  });
+  const Sample& median = samples[samples.size() / 2];
+  report.level = index;
+  report.solved = median.solved != 0;
+  report.pushes = median.pushes;
+  report.expanded = median.expanded;
+  report.medianMs = median.elapsedUs / 1000.0;
+  report.nodesPerSec = median.elapsedUs == 0 ? 0 : median.expanded * 1e6 / median.elapsedUs;
+  for (const auto& sample : samples) report.peakRssKb = std::max(report.peakRssKb, sample.peakRssKb);
+  return true;
+}
+
+void printReport(FILE* out, const LevelReport& report) {
+  fprintf(out, "{\"level\": %d, \"solved\": %s, \"pushes\": %lu, \"expanded\": %lu, \"median_ms\": %.3f, "
+      "\"nodes_per_sec\": %.0f, \"peak_rss_kb\": %ld}\n",
+      report.level, report.solved ? "true" : "false", report.pushes, report.expanded,
+      report.medianMs, report.nodesPerSec, report.peakRssKb);
+}
+
+// 取出一行 JSON 里 "key": 后面的值, 只认本程序自己写出的格式
+bool findField(const std::string& line, const char* key, std::string& value) {
+  std::string pattern = std::string("\"") + key + "\": ";
+  size_t pos = line.find(pattern);
+  if (pos == std::string::npos) return false;
+  pos += pattern.size();
+  size_t end = line.find_first_of(",}", pos);
+  value = line.substr(pos, end - pos);
+  return true;
+}
+
+bool loadBaseline(const char* path, std::map<int, LevelReport>& baseline) {
+  std::ifstream in(path);
+  if (!in) return false;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::string level, solved, expanded, median, rss;
+    if (!findField(line, "level", level) || !findField(line, "solved", solved) ||
+        !findField(line, "expanded", expanded) || !findField(line, "median_ms", median) ||
+        !findField(line, "peak_rss_kb", rss)) {
+      continue;
+    }
+    LevelReport report;
+    report.level = atoi(level.c_str());
+    report.solved = solved == "true";
+    report.expanded = strtoull(expanded.c_str(), nullptr, 10);
+    report.medianMs = atof(median.c_str());
+    report.peakRssKb = atol(rss.c_str());
+    baseline[report.level] = report;
+  }
+  return true;
+}
+
+double increase(double current, double base) {
+  return base <= 0 ? 0 : (current - base) * 100 / base;
+}
+
+// 返回退化的项数, 逐项打印到 stderr
+int compare(const LevelReport& current, const LevelReport& base, const Config& config) {
+  int regressions = 0;
+  if (base.solved && !current.solved) {
+    fprintf(stderr, "level %d: REGRESSION no longer solved\n", current.level);
+    return 1;
+  }
+  if (current.solved && base.solved && increase(current.expanded, base.expanded) > config.threshold) {
+    fprintf(stderr, "level %d: REGRESSION expanded %lu -> %lu (+%.1f%%)\n", current.level,
+        base.expanded, current.expanded, increase(current.expanded, base.expanded));
+    ++regressions;
+  }
+  if (std::max(current.medianMs, base.medianMs) >= config.minComparableMs &&
+      increase(current.medianMs, base.medianMs) > config.threshold) {
+    fprintf(stderr, "level %d: REGRESSION median %.1f ms -> %.1f ms (+%.1f%%)\n", current.level,
+        base.medianMs, current.medianMs, increase(current.medianMs, base.medianMs));
+    ++regressions;
+  }
+  if (increase(current.peakRssKb, base.peakRssKb) > config.threshold) {
+    fprintf(stderr, "level %d: REGRESSION peak rss %ld KB -> %ld KB (+%.1f%%)\n", current.level,
+        base.peakRssKb, current.peakRssKb, increase(current.peakRssKb, base.peakRssKb));
+    ++regressions;
+  }
+  return regressions;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Config config;
+  config.options.verbose = false;
+  config.options.timeLimitMs = 10 * 1000;
+  int opt;
+  while ((opt = getopt(argc, argv, "l:r:T:M:t:m:j:o:B:R:")) != -1) {
+    switch (opt) {
+      case 'l':
+        if (!parseRange(optarg, config.first, config.last)) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'r':
+        config.repeats = std::max(1, atoi(optarg));
+        break;
+      case 'T':
+        config.options.timeLimitMs = static_cast<uint64_t>(atoi(optarg)) * 1000;
+        break;
+      case 'M':
+        config.options.memoryLimitBytes = static_cast<size_t>(atoi(optarg)) << 20;
+        break;
+      case 't':
+        config.options.transpositionBytes = static_cast<size_t>(atoi(optarg)) << 20;
+        break;
+      case 'm':
+        if (strcmp(optarg, "astar") == 0) {
+          config.mode = Mode::kAstar;
+        } else if (strcmp(optarg, "ida") == 0) {
+          config.mode = Mode::kIda;
+        } else if (strcmp(optarg, "parallel") == 0) {
+          config.mode = Mode::kParallel;
+        } else if (strcmp(optarg, "bidir") == 0) {
+          config.mode = Mode::kBidirectional;
+        } else {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'j':
+        config.threads = std::max(1, atoi(optarg));
+        break;
+      case 'o':
+        config.outputPath = optarg;
+        break;
+      case 'B':
+        config.baselinePath = optarg;
+        break;
+      case 'R':
+        config.threshold = atof(optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  std::map<int, LevelReport> baseline;
+  if (config.baselinePath != nullptr && !loadBaseline(config.baselinePath, baseline)) {
+    fprintf(stderr, "failed to read baseline %s\n", config.baselinePath);
+    return 1;
+  }
+  FILE* out = stdout;
+  if (config.outputPath != nullptr) {
+    out = fopen(config.outputPath, "w");
+    if (out == nullptr) {
+      fprintf(stderr, "failed to open %s\n", config.outputPath);
+      return 1;
+    }
+  }
+
+  LevelArray levels;
+  getAllLevels(levels);
+  int last = std::min(config.last, static_cast<int>(levels.size()));
+  int regressions = 0;
+  for (int level = config.first; level <= last; ++level) {
+    LevelReport report;
+    if (!benchLevel(levels[level - 1], level, config, report)) {
+      fprintf(stderr, "level %d: run failed\n", level);
+      ++regressions;
+      continue;
+    }
+    printReport(out, report);
+    fflush(out);
+    auto it = baseline.find(level);
+    if (it != baseline.end()) regressions += compare(report, it->second, config);
+  }
+  if (out != stdout) fclose(out);
+  if (config.baselinePath != nullptr) {
+    fprintf(stderr, "%d regression(s) against %s (threshold %.1f%%)\n", regressions,
+        config.baselinePath, config.threshold);
+  }
+  return regressions == 0 ? 0 : 1;
+}
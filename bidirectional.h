@@ -0,0 +1,347 @@
+#ifndef WSUN_SOKOBAN_BIDIRECTIONAL_H
+#define WSUN_SOKOBAN_BIDIRECTIONAL_H
+
+#include "solver.h"
+
+// 双向搜索: 正向 A* 从初始局面推箱子, 反向搜索从所有箱子都在目标上的局面拉箱子.
+// 两边各有一张以归一化 Zobrist 为键的置换表, 值为节点下标, 展开节点时查对方的表,
+// 查到即相遇, 拼接两段路径得到解.
+//
+// 反向搜索树: 0号为虚根(箱子在目标上, 玩家位置无意义), 它的子节点是玩家最后可能
+// 所在的各个区域(dir 为0, boxSolt 为区域内一格), 再往下才是拉箱子.
+// 反向节点的深度和 g 相同, 实际拉动次数是 g - 1.
+namespace bidir {
+
+static void placePlayer(Board& board, int solt) {
+  board.map[board.playerSolt] ^= SquareType::kPlayer;
+  board.zobrist.XOR(board.context->playerKey(board.playerSolt));
+  board.map[solt] |= SquareType::kPlayer;
+  board.zobrist.XOR(board.context->playerKey(solt));
+  board.playerSolt = solt;
+}
+
+// 拉箱子: 玩家站在 boxSolt + dir, 向 dir 退一步, 箱子跟到 boxSolt + dir.
+// 它正好是正向推动 Push(boxSolt + dir, -dir, boxSolt + 2 * dir) 的逆操作.
+static Push pullToPush(int boxSolt, Direction dir) {
+  return Push(boxSolt + dir, -dir, boxSolt + 2 * dir);
+}
+
+static void doPull(Board& board, int boxSolt, Direction dir) {
+  undoPush(board, pullToPush(boxSolt, dir));
+}
+
+static void undoPull(Board& board, int boxSolt, Direction dir) {
+  Push push = pullToPush(boxSolt, dir);
+  push.playerSolt = board.playerSolt;
+  doPush(board, push);
+}
+
+// getPushes 的镜像: 玩家能走到箱子旁边, 并且身后还有空位可以退
+static void getPulls(const Board& board, const Reach& reach, std::vector<Push>& pulls) {
+  const auto dirs = board.context->directions;
+  for (int boxSolt : board.boxes) {
+    for (auto dir : dirs) {
+      int playerSolt = boxSolt + dir;
+      if (reach.isReachableBox(playerSolt) &&
+          !(board.map[playerSolt + dir] & (kWall | kBox))) {
+        pulls.emplace_back(boxSolt, dir, board.playerSolt);
+      }
+    }
+  }
+}
+
+static void redoBackward(Board& board, const SearchNode& node) {
+  if (node.dir == 0) {
+    placePlayer(board, node.boxSolt);
+  } else {
+    doPull(board, node.boxSolt, node.dir);
+  }
+}
+
+static void undoBackward(Board& board, const SearchNode& node, int rootPlayerSolt) {
+  if (node.dir == 0) {
+    placePlayer(board, rootPlayerSolt);
+  } else {
+    undoPull(board, node.boxSolt, node.dir);
+  }
+}
+
+// 同 moveToNode, 只是节点上记录的是拉动
+static void moveToBackwardNode(Board& board, const NodeArena& nodes, int rootPlayerSolt,
+    uint32_t from, uint32_t to, std::vector<uint32_t>& path) {
+  path.clear();
+  while (nodes[from].depth > nodes[to].depth) {
+    undoBackward(board, nodes[from], rootPlayerSolt);
+    from = nodes[from].parent;
+  }
+  while (nodes[to].depth > nodes[from].depth) {
+    path.push_back(to);
+    to = nodes[to].parent;
+  }
+  while (from != to) {
+    undoBackward(board, nodes[from], rootPlayerSolt);
+    from = nodes[from].parent;
+    path.push_back(to);
+    to = nodes[to].parent;
+  }
+  for (auto it = path.rbegin(); it != path.rend(); ++it) {
+    redoBackward(board, nodes[*it]);
+  }
+}
+
+// 每个箱子到最近的初始箱子位置的曼哈顿距离之和, 只用来给反向搜索排序
+static int backwardCost(const Board& board, const BoxSet& targets) {
+  int d = 0;
+  for (int box : board.boxes) {
+    int best = INT_MAX;
+    for (int target : targets) {
+      best = std::min(best, static_cast<int>(distance(box, target, board.file)));
+    }
+    d += best;
+  }
+  return d;
+}
+
+// 箱子全部放在目标上之后, 玩家可能停留的每个连通区域取一格.
+// 只在初始玩家能走到的范围(不计箱子)内找, 并且区域要挨着箱子, 否则最后一步推不出来.
+static void finalPlayerRegions(const Board& board, std::vector<int>& starts) {
+  const auto dirs = board.context->directions;
+  std::vector<char> inside(board.map.size(), 0);
+  std::vector<int> stack(1, board.playerSolt);
+  inside[board.playerSolt] = 1;
+  while (!stack.empty()) {
+    int solt = stack.back();
+    stack.pop_back();
+    for (auto dir : dirs) {
+      int dest = solt + dir;
+      if (!inside[dest] && !(board.map[dest] & kWall)) {
+        inside[dest] = 1;
+        stack.push_back(dest);
+      }
+    }
+  }
+
+  std::vector<char> seen(board.map.size(), 0);
+  for (size_t i = 0; i < board.map.size(); ++i) {
+    if (!inside[i] || seen[i] || board.goals.contains(i)) continue;
+    bool touchesBox = false;
+    stack.assign(1, i);
+    seen[i] = 1;
+    while (!stack.empty()) {
+      int solt = stack.back();
+      stack.pop_back();
+      for (auto dir : dirs) {
+        int dest = solt + dir;
+        if (board.goals.contains(dest)) {
+          touchesBox = true;
+        } else if (inside[dest] && !seen[dest]) {
+          seen[dest] = 1;
+          stack.push_back(dest);
+        }
+      }
+    }
+    if (touchesBox) starts.push_back(i);
+  }
+}
+
+} // namespace bidir
+
+static SearchResult bidirectionalSearch(Board& board, const SearchOptions& options = SearchOptions()) {
+  uint64_t startTime = getNowTime();
+  SearchResult result;
+  DeadLock dl;
+  dl.generate(board);
+  const Board start(board);
+  Heuristic heuristic(options.heuristic, dl, board);
+  heuristic.reset(board);
+  if (heuristic.value() == Heuristic::kDeadlock) return result;
+  board.heuristic = &heuristic;
+  PatternDatabase patterns;
+  if (options.patterns != nullptr) patterns.copyFrom(*options.patterns);
+  MacroMoves macros;
+  macros.generate(board, dl);
+  CorralPruner corrals(dl, board);
+
+  // 两张表平分置换表内存
+  TranspositionTable forwardVisited(options.transpositionBytes / 2, positionBound(board, dl));
+  TranspositionTable backwardVisited(options.transpositionBytes / 2, positionBound(board, dl));
+
+  NodeArena forwardNodes;
+  forwardNodes.add(SearchNode{ kNoParent, 0, 0, 0, 0, static_cast<uint16_t>(heuristic.value()), 0, kNoMacro });
+  BucketQueue<uint32_t> forwardFrontier;
+  forwardFrontier.push(0, heuristic.value(), 0);
+
+  Board backward(start);
+  DynamicData goalData;
+  goalData.boxes = start.goals;
+  goalData.playerSolt = start.playerSolt;
+  std::vector<int> regions;
+  bidir::finalPlayerRegions(start, regions);
+  // 初始玩家位置上可能有目标, 先把玩家放到一个区域里再摆箱子
+  if (!regions.empty()) bidir::placePlayer(backward, regions.front());
+  goalData.playerSolt = backward.playerSolt;
+  backward.recoverFromData(goalData);
+  const int rootPlayerSolt = backward.playerSolt;
+  NodeArena backwardNodes;
+  backwardNodes.add(SearchNode{ kNoParent, 0, 0, 0, 0, 0, 0, kNoMacro });
+  BucketQueue<uint32_t> backwardFrontier;
+  for (int solt : regions) {
+    uint32_t idx = backwardNodes.add(SearchNode{ 0, static_cast<uint16_t>(solt), 0, 1, 1, 0,
+        static_cast<uint16_t>(solt), kNoMacro });
+    backwardFrontier.push(idx, 0, 0);
+  }
+
+  uint32_t forwardCurrent = 0;
+  uint32_t backwardCurrent = 0;
+  uint32_t forwardMeet = kNoParent;
+  uint32_t backwardMeet = kNoParent;
+  std::vector<uint32_t> path;
+  std::vector<Push> moves;
+  std::vector<Push> macroPushes;
+  // 置换表按需扩容, 搜索中定期取样, 结束时再取一次
+  auto sampleMemory = [&] {
+    result.peakMemoryBytes = std::max(result.peakMemoryBytes,
+        forwardNodes.memoryBytes() + backwardNodes.memoryBytes() +
+        forwardVisited.memoryBytes() + backwardVisited.memoryBytes() +
+        forwardFrontier.memoryBytes() + backwardFrontier.memoryBytes());
+  };
+  while (!forwardFrontier.empty() || !backwardFrontier.empty()) {
+    if ((result.explorNodes & 1023) == 0) {
+      sampleMemory();
+      if (options.memoryLimitBytes != 0 && result.peakMemoryBytes > options.memoryLimitBytes) {
+        result.status = SearchStatus::kMemoryLimit;
+        break;
+      }
+      if (options.timeLimitMs != 0 && (getNowTime() - startTime) / 1000000 > options.timeLimitMs) {
+        result.status = SearchStatus::kTimeLimit;
+        break;
+      }
+    }
+
+    // 开放表小的一边先走, 两边的搜索量大致持平
+    bool forward = backwardFrontier.empty() ||
+      (!forwardFrontier.empty() && forwardFrontier.size() <= backwardFrontier.size());
+    if (forward) {
+      uint32_t idx = forwardFrontier.pop();
+      moveToNode(board, forwardNodes, macros, forwardCurrent, idx, path);
+      forwardCurrent = idx;
+      Reach reach;
+      calcReachableTiles(board, reach);
+      Zobrist key = board.normalizedZobrist(reach.minReachableSolt);
+      uint16_t g = forwardNodes[idx].g;
+      if (!forwardVisited.insert(key, g, idx)) continue;
+      ++result.explorNodes;
+
+      if (checkGameOver(board)) {
+        forwardMeet = idx;
+        break;
+      }
+      int otherG;
+      uint32_t other;
+      if (backwardVisited.lookup(key, &otherG, &other)) {
+        forwardMeet = idx;
+        backwardMeet = other;
+        break;
+      }
+
+      moves.clear();
+      getPushes(board, reach, moves);
+      if (corrals.prune(board, reach, moves)) ++result.corralNodes;
+      bool expanded = false;
+      for (const auto& p : moves) {
+        ++result.generateNodes;
+        if (dl.isDeadSolt(p.boxSolt + p.dir)) continue;
+        doPush(board, p);
+        macroPushes.clear();
+        MacroType macro = macros.extend(board, p, macroPushes);
+        int dest = macroPushes.empty() ? p.boxSolt + p.dir : macroPushes.back().boxSolt + macroPushes.back().dir;
+        bool frozen = dl.isFreezeDeadlock(board, dest);
+        bool pattern = !frozen && patterns.isDeadlock(board, dest);
+        int h = heuristic.value();
+        undoPushes(board, macroPushes);
+        undoPush(board, p);
+        if (frozen) {
+          ++result.frozenNodes;
+          continue;
+        }
+        if (pattern) {
+          ++result.patternNodes;
+          continue;
+        }
+        if (h == Heuristic::kDeadlock) {
+          ++result.deadlockNodes;
+          continue;
+        }
+        uint16_t childG = g + 1 + macroPushes.size();
+        uint32_t child = forwardNodes.add(SearchNode{ idx, static_cast<uint16_t>(p.boxSolt),
+            static_cast<int16_t>(p.dir), static_cast<uint16_t>(forwardNodes[idx].depth + 1), childG,
+            static_cast<uint16_t>(h), static_cast<uint16_t>(dest), macro });
+        forwardFrontier.push(child, childG + h, childG);
+        expanded = true;
+      }
+      if (!expanded && idx != 0) patterns.learn(board, forwardNodes[idx].destSolt);
+    } else {
+      uint32_t idx = backwardFrontier.pop();
+      bidir::moveToBackwardNode(backward, backwardNodes, rootPlayerSolt, backwardCurrent, idx, path);
+      backwardCurrent = idx;
+      Reach reach;
+      calcReachableTiles(backward, reach);
+      Zobrist key = backward.normalizedZobrist(reach.minReachableSolt);
+      uint16_t g = backwardNodes[idx].g;
+      if (!backwardVisited.insert(key, g, idx)) continue;
+      ++result.explorNodes;
+
+      int otherG;
+      uint32_t other;
+      if (forwardVisited.lookup(key, &otherG, &other)) {
+        forwardMeet = other;
+        backwardMeet = idx;
+        break;
+      }
+
+      moves.clear();
+      bidir::getPulls(backward, reach, moves);
+      for (const auto& p : moves) {
+        ++result.generateNodes;
+        bidir::doPull(backward, p.boxSolt, p.dir);
+        int h = bidir::backwardCost(backward, start.boxes);
+        bidir::undoPull(backward, p.boxSolt, p.dir);
+        uint32_t child = backwardNodes.add(SearchNode{ idx, static_cast<uint16_t>(p.boxSolt),
+            static_cast<int16_t>(p.dir), static_cast<uint16_t>(g + 1), static_cast<uint16_t>(g + 1),
+            static_cast<uint16_t>(h), static_cast<uint16_t>(p.boxSolt + p.dir), kNoMacro });
+        backwardFrontier.push(child, g + 1 + h, g + 1);
+      }
+    }
+  }
+  sampleMemory();
+  board.heuristic = nullptr;
+  if (options.patterns != nullptr) options.patterns->merge(patterns);
+
+  if (forwardMeet != kNoParent) {
+    collectPushes(forwardNodes, macros, forwardMeet, result.pushes);
+    // 反向路径从相遇点往回走, 每次拉动反过来就是一次推动
+    for (uint32_t idx = backwardMeet; idx != kNoParent && backwardNodes[idx].dir != 0;
+        idx = backwardNodes[idx].parent) {
+      const SearchNode& node = backwardNodes[idx];
+      result.pushes.push_back(bidir::pullToPush(node.boxSolt, node.dir));
+    }
+    if (expandToMoves(start, result.pushes, result.moves)) {
+      result.status = SearchStatus::kSolved;
+    } else {
+      result.pushes.clear();
+      result.moves.clear();
+    }
+  }
+  result.timeMs = (getNowTime() - startTime) / 1000000;
+  if (options.verbose) {
+    printf("%s in bidirectional search, forward nodes: %u, backward nodes: %u\n",
+        result.solved() ? "find way" : statusName(result.status),
+        forwardNodes.size(), backwardNodes.size());
+    printf("generateNodes: %lu, explorNodes: %lu, deadlockNodes: %lu, frozenNodes: %lu, patternNodes: %lu, corralNodes: %lu, spent time: %lu ms\n",
+        result.generateNodes, result.explorNodes, result.deadlockNodes, result.frozenNodes, result.patternNodes,
+        result.corralNodes, result.timeMs);
+  }
+  return result;
+}
+
+#endif
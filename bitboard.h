@@ -0,0 +1,166 @@
+#ifndef WSUN_SOKOBAN_BITBOARD_H_
+#define WSUN_SOKOBAN_BITBOARD_H_
+
+#include <inttypes.h>
+#include <cstring>
+#include <cassert>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// 按格子序号排列的定长位图, 第 solt 位对应 map[solt].
+// 有效字的前后各留 kGuard 个全零字, 内核按字平移时可以直接越界读邻字, 不用判断边界.
+class Bitboard {
+ public:
+  static const int kMaxSquares = 2048;
+  static const int kGuard = 4;
+  static const int kMaxWords = kMaxSquares / 64;
+
+  Bitboard() : words_(0) {
+    std::memset(bits_, 0, 2 * kGuard * sizeof(uint64_t));
+  }
+
+  explicit Bitboard(int squares) {
+    reset(squares);
+  }
+
+  Bitboard(const Bitboard& other) {
+    *this = other;
+  }
+
+  Bitboard& operator=(const Bitboard& other) {
+    words_ = other.words_;
+    std::memcpy(bits_, other.bits_, (words_ + 2 * kGuard) * sizeof(uint64_t));
+    return *this;
+  }
+
+  // 清零并设定格子数, 有效字数按4对齐, 方便 AVX2 一次处理4个字
+  void reset(int squares) {
+    assert(squares <= kMaxSquares);
+    words_ = ((squares + 63) / 64 + 3) & ~3;
+    std::memset(bits_, 0, (words_ + 2 * kGuard) * sizeof(uint64_t));
+  }
+
+  int words() const { return words_; }
+  uint64_t* data() { return bits_ + kGuard; }
+  const uint64_t* data() const { return bits_ + kGuard; }
+
+  bool test(int solt) const {
+    return (data()[solt >> 6] >> (solt & 63)) & 1;
+  }
+
+  void set(int solt) {
+    data()[solt >> 6] |= uint64_t(1) << (solt & 63);
+  }
+
+  void clear(int solt) {
+    data()[solt >> 6] &= ~(uint64_t(1) << (solt & 63));
+  }
+
+  // 最小的置位格子, 没有返回 -1
+  int first() const {
+    const uint64_t* w = data();
+    for (int i = 0; i < words_; ++i) {
+      if (w[i]) return i * 64 + __builtin_ctzll(w[i]);
+    }
+    return -1;
+  }
+
+ private:
+  alignas(32) uint64_t bits_[kMaxWords + 2 * kGuard];
+  int words_;
+};
+
+namespace bitboard {
+
+// 下面的内核都带一个宽度模板参数: kFile 不为0时它就是 file, 平移量全是编译期常量;
+// 为0是通用版本, 用运行期传进来的 file.
+
+// 第 i 个字里每一位换成它的四个邻格之一(±1, ±file)是否置位. 要求 0 < file < 64,
+// 关卡四周是墙, 所以行首行尾的位跨行串到一起也不影响结果
+template <int kFile = 0>
+inline uint64_t neighbors(const uint64_t* w, int i, int runtimeFile) {
+  const int file = kFile != 0 ? kFile : runtimeFile;
+  uint64_t x = w[i];
+  return (x << 1) | (w[i - 1] >> 63) | (x >> 1) | (w[i + 1] << 63) |
+    (x << file) | (w[i - 1] >> (64 - file)) | (x >> file) | (w[i + 1] << (64 - file));
+}
+
+// 先在字内扩散到不动点, 再由外层来回扫描把结果传到相邻的字
+template <int kFile = 0>
+inline bool expandWord(uint64_t* r, const uint64_t* walls, const uint64_t* boxes, int i, int runtimeFile) {
+  const int file = kFile != 0 ? kFile : runtimeFile;
+  uint64_t open = ~(walls[i] | boxes[i]);
+  uint64_t old = r[i];
+  uint64_t x = (old | neighbors<kFile>(r, i, file)) & open;
+  uint64_t prev = old;
+  while (x != prev) {
+    prev = x;
+    x = (x | (x << 1) | (x >> 1) | (x << file) | (x >> file)) & open;
+  }
+  r[i] = x;
+  return x != old;
+}
+
+#ifdef __AVX2__
+// 4个字一组做同样的扩散; 跨字的进位从内存里错开一个字读出来
+template <int kFile = 0>
+inline bool expandBlock(uint64_t* r, const uint64_t* walls, const uint64_t* boxes, int i, int runtimeFile) {
+  const int file = kFile != 0 ? kFile : runtimeFile;
+  const __m128i one = _mm_cvtsi32_si128(1);
+  const __m128i sixtyThree = _mm_cvtsi32_si128(63);
+  const __m128i up = _mm_cvtsi32_si128(file);
+  const __m128i carry = _mm_cvtsi32_si128(64 - file);
+  __m256i open = _mm256_andnot_si256(
+      _mm256_or_si256(_mm256_load_si256(reinterpret_cast<const __m256i*>(walls + i)),
+        _mm256_load_si256(reinterpret_cast<const __m256i*>(boxes + i))),
+      _mm256_set1_epi64x(-1));
+  __m256i old = _mm256_load_si256(reinterpret_cast<const __m256i*>(r + i));
+  __m256i x = old;
+  for (;;) {
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r + i - 1));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r + i + 1));
+    __m256i next = _mm256_or_si256(
+        _mm256_or_si256(
+          _mm256_or_si256(_mm256_sll_epi64(x, one), _mm256_srl_epi64(lo, sixtyThree)),
+          _mm256_or_si256(_mm256_srl_epi64(x, one), _mm256_sll_epi64(hi, sixtyThree))),
+        _mm256_or_si256(
+          _mm256_or_si256(_mm256_sll_epi64(x, up), _mm256_srl_epi64(lo, carry)),
+          _mm256_or_si256(_mm256_srl_epi64(x, up), _mm256_sll_epi64(hi, carry))));
+    next = _mm256_and_si256(_mm256_or_si256(next, x), open);
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi64(next, x)) == -1) break;
+    x = next;
+    _mm256_store_si256(reinterpret_cast<__m256i*>(r + i), x);
+  }
+  return _mm256_movemask_epi8(_mm256_cmpeq_epi64(x, old)) != -1;
+}
+#endif
+
+// 从 region 里的格子出发, 在不是墙也不是箱子的格子上扩散到不动点.
+// 正反两个方向交替扫描, 每遍都用本遍已经更新过的邻字, 通常几遍就收敛
+template <int kFile = 0>
+inline void flood(uint64_t* region, const uint64_t* walls, const uint64_t* boxes, int words, int file) {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+#ifdef __AVX2__
+    for (int i = 0; i < words; i += 4) changed |= expandBlock<kFile>(region, walls, boxes, i, file);
+    for (int i = words - 4; i >= 0; i -= 4) changed |= expandBlock<kFile>(region, walls, boxes, i, file);
+#else
+    for (int i = 0; i < words; ++i) changed |= expandWord<kFile>(region, walls, boxes, i, file);
+    for (int i = words - 1; i >= 0; --i) changed |= expandWord<kFile>(region, walls, boxes, i, file);
+#endif
+  }
+}
+
+// sides = region 中挨着箱子的格子
+template <int kFile = 0>
+inline void boxSides(const uint64_t* region, const uint64_t* boxes, uint64_t* sides, int words, int file) {
+  for (int i = 0; i < words; ++i) {
+    sides[i] = region[i] & neighbors<kFile>(boxes, i, file);
+  }
+}
+
+} // namespace bitboard
+
+#endif // #ifndef WSUN_SOKOBAN_BITBOARD_H_
@@ -0,0 +1,102 @@
+#ifndef WSUN_SOKOBAN_BOXSET_H
+#define WSUN_SOKOBAN_BOXSET_H
+
+#include <inttypes.h>
+#include <array>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+
+static const int kMaxBoxes = 64;
+
+// 按格子序号升序保存的定长箱子集合, 不做任何堆分配.
+// 未使用的槽位始终为0, 所以相等比较/哈希可以直接按整块内存进行.
+class BoxSet {
+ public:
+  using Solt = uint16_t;
+  using const_iterator = const Solt*;
+
+  BoxSet() : size_(0) {
+    solts_.fill(0);
+  }
+
+  int size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const_iterator begin() const { return solts_.data(); }
+  const_iterator end() const { return solts_.data() + size_; }
+  int operator[](int i) const { return solts_[i]; }
+
+  void clear() {
+    solts_.fill(0);
+    size_ = 0;
+  }
+
+  bool contains(int solt) const {
+    return std::binary_search(begin(), end(), static_cast<Solt>(solt));
+  }
+
+  void insert(int solt) {
+    assert(size_ < kMaxBoxes);
+    Solt* pos = std::lower_bound(solts_.data(), solts_.data() + size_, static_cast<Solt>(solt));
+    if (pos != end() && *pos == solt) return;
+    std::copy_backward(pos, solts_.data() + size_, solts_.data() + size_ + 1);
+    *pos = static_cast<Solt>(solt);
+    ++size_;
+  }
+
+  void erase(int solt) {
+    Solt* pos = std::lower_bound(solts_.data(), solts_.data() + size_, static_cast<Solt>(solt));
+    if (pos == end() || *pos != solt) return;
+    std::copy(pos + 1, solts_.data() + size_, pos);
+    solts_[--size_] = 0;
+  }
+
+  // 推箱子只会移动一个箱子, 原地挪动保持有序, 比 erase + insert 少一次搬移
+  void move(int from, int to) {
+    Solt* pos = std::lower_bound(solts_.data(), solts_.data() + size_, static_cast<Solt>(from));
+    assert(pos != end() && *pos == from);
+    Solt* last = solts_.data() + size_ - 1;
+    if (to > from) {
+      while (pos != last && *(pos + 1) < to) {
+        *pos = *(pos + 1);
+        ++pos;
+      }
+    } else {
+      while (pos != solts_.data() && *(pos - 1) > to) {
+        *pos = *(pos - 1);
+        --pos;
+      }
+    }
+    *pos = static_cast<Solt>(to);
+  }
+
+  uint64_t hash() const {
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(solts_.data());
+    for (int i = 0; i < size_ * static_cast<int>(sizeof(Solt)); ++i) {
+      h ^= p[i];
+      h *= 1099511628211ULL;
+    }
+    return h;
+  }
+
+  bool operator==(const BoxSet& rhs) const {
+    return size_ == rhs.size_ &&
+      std::memcmp(solts_.data(), rhs.solts_.data(), sizeof(solts_)) == 0;
+  }
+
+  bool operator!=(const BoxSet& rhs) const {
+    return !operator==(rhs);
+  }
+
+  bool operator<(const BoxSet& rhs) const {
+    return std::lexicographical_compare(begin(), end(), rhs.begin(), rhs.end());
+  }
+
+ private:
+  std::array<Solt, kMaxBoxes> solts_;
+  int size_;
+};
+
+#endif
@@ -24,6 +24,7 @@ static const std::map<SquareType, char> kSymbolsReverseMap = {
   { SquareType::kPlayer, '@' },
   { SquareType::kBoxOnGoal, '*' },
   { SquareType::kPlayerOnGoal, '+' },
+  { SquareType::kEmpty, ' ' },
 };
 
 // left right up down
@@ -31,8 +32,16 @@ static const Direction Left = 0;
 static const Direction Right = 1;
 static const Direction Up = 2;
 static const Direction Down = 3;
-static std::array<Direction, 4> kDirection = { -1, 1, 0, 0 };
 
 static const char* kLevelDataDirPath = "screens";
 
+// 置换表默认内存大小(MB)
+static const size_t kDefaultTranspositionMB = 256;
+
+// 外存搜索没有内存限制时, 攒子局面的缓冲区大小
+static const size_t kDefaultRunBufferBytes = 256 << 20;
+
+// recoverFromData 时不同的箱子不超过这个数就逐个增量更新估值, 否则整体重算
+static const int kIncrementalRecoverLimit = 4;
+
 #endif
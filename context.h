@@ -0,0 +1,80 @@
+#ifndef WSUN_SOKOBAN_CONTEXT_H_
+#define WSUN_SOKOBAN_CONTEXT_H_
+
+#include "types.h"
+#include "config.h"
+#include "zobrist.h"
+#include <array>
+#include <vector>
+
+struct Board;
+struct Reach;
+struct Push;
+
+// 按关卡宽度实例化的热点函数. 建立上下文时选定一次, 之后每次调用不再看宽度
+struct SearchKernels {
+  void (*calcReach)(const Board& board, Reach& reach);
+  void (*updateReach)(const Board& board, const Reach& parent, const Push& push, Reach& reach);
+  void (*getPushes)(const Board& board, const Reach& reach, std::vector<Push>& pushes);
+};
+
+// 一个关卡求解期间不变的数据: 方向偏移, 内部格子的编号, Zobrist 键表和按宽度选好的内核.
+// Board 构造时建立, 拷贝出来的 Board 共享同一份只读的上下文. 不同关卡各有各的,
+// 同一进程里可以同时求解不同宽度的关卡, 也不再依赖全局变量.
+struct SolverContext {
+  int file;
+  // 按 Left/Right/Up/Down 排列的格子偏移
+  std::array<Direction, 4> directions;
+  // 内部格子(既不是墙也不在墙外)按格子序号紧凑编号. cellOf[solt] 是编号, 其余格子为 -1;
+  // solts[cell] 反过来. 编号 wall() 是墙的哨兵, 它的邻格还是它自己
+  std::vector<int> cellOf;
+  std::vector<int> solts;
+  // neighbors[cell][dir] 是四个方向上邻格的编号, 不是内部格子的为 wall()
+  std::vector<std::array<int, 4>> neighbors;
+  // 按编号排列, 只给内部格子生成
+  std::vector<Zobrist> playerZobrists;
+  std::vector<Zobrist> boxZobrists;
+  SearchKernels kernels;
+
+  // map 已经过 Board 的预处理: 内部格子四周不是内部格子就是墙, 不会碰到地图边上
+  SolverContext(const Map& map, int file, const SearchKernels& kernels)
+    : file(file),
+      directions{ { -1, 1, -file, file } },
+      cellOf(map.size(), -1),
+      kernels(kernels) {
+    for (size_t i = 0; i < map.size(); ++i) {
+      if (map[i] & (SquareType::kWall | SquareType::kEmpty)) continue;
+      cellOf[i] = solts.size();
+      solts.push_back(i);
+    }
+    neighbors.resize(solts.size() + 1);
+    for (int cell = 0; cell < cells(); ++cell) {
+      for (int d = 0; d < 4; ++d) {
+        int next = cellOf[solts[cell] + directions[d]];
+        neighbors[cell][d] = next < 0 ? wall() : next;
+      }
+    }
+    neighbors[wall()].fill(wall());
+
+    // 键表只由内部格子数决定, 同一关卡每次得到的键都一样
+    playerZobrists.resize(solts.size());
+    boxZobrists.resize(solts.size());
+    RC4 rc4;
+    for (auto& zobrist : playerZobrists) zobrist = Zobrist(rc4);
+    for (auto& zobrist : boxZobrists) zobrist = Zobrist(rc4);
+  }
+
+  int cells() const { return static_cast<int>(solts.size()); }
+  int wall() const { return cells(); }
+
+  const Zobrist& playerKey(int solt) const { return playerZobrists[cellOf[solt]]; }
+  const Zobrist& boxKey(int solt) const { return boxZobrists[cellOf[solt]]; }
+
+  char directionChar(Direction dir) const {
+    if (dir == directions[Left]) return 'l';
+    if (dir == directions[Right]) return 'r';
+    return dir == directions[Up] ? 'u' : 'd';
+  }
+};
+
+#endif // #ifndef WSUN_SOKOBAN_CONTEXT_H_
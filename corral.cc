@@ -0,0 +1,182 @@
+#include "corral.h"
+#include "solver.h"
+#include <unordered_set>
+
+CorralPruner::CorralPruner(const DeadLock& dl, const Board& board)
+  : dl_(dl),
+    scratch_(new Board(board)),
+    inside_(board.map.size(), 0),
+    barrier_(board.map.size(), 0),
+    component_(board.map.size(), -1),
+    best_(board.map.size(), 0),
+    bestBarrier_(board.map.size(), 0) {
+  scratch_->heuristic = nullptr;
+  // 不计箱子时玩家能走到的范围就是关卡内部, 关卡外面的空地不参与 corral 划分
+  const int dirs[4] = { -1, 1, -board.file, board.file };
+  std::vector<int> stack(1, board.playerSolt);
+  inside_[board.playerSolt] = 1;
+  while (!stack.empty()) {
+    int solt = stack.back();
+    stack.pop_back();
+    for (int dir : dirs) {
+      int next = solt + dir;
+      if (!inside_[next] && !(board.map[next] & SquareType::kWall)) {
+        inside_[next] = 1;
+        stack.push_back(next);
+      }
+    }
+  }
+}
+
+CorralPruner::~CorralPruner() {
+}
+
+bool CorralPruner::prune(const Board& m, const Reach& reach, std::vector<Push>& pushes) {
+  const int dirs[4] = { -1, 1, -m.file, m.file };
+  auto reachable = [&reach](int solt) {
+    return reach.contains(solt);
+  };
+  // 挨着玩家区域的箱子是边界箱子, 其余走不到的格子按连通性分成各个 corral
+  for (int box : m.boxes) {
+    for (int dir : dirs) {
+      if (reachable(box + dir)) barrier_[box] = 1;
+    }
+  }
+
+  int bestPushes = INT_MAX;
+  marked_.clear();
+  for (size_t start = 0; start < m.map.size(); ++start) {
+    if (!inside_[start] || component_[start] != -1 || reachable(start) || barrier_[start]) continue;
+    squares_.assign(1, start);
+    component_[start] = start;
+    marked_.push_back(start);
+    boxes_.clear();
+    bool unsolved = false;
+    for (size_t i = 0; i < squares_.size(); ++i) {
+      int solt = squares_[i];
+      SquareType st = m.map[solt];
+      if ((st & SquareType::kBox) != 0 && !(st & SquareType::kGoal)) unsolved = true;
+      if ((st & SquareType::kGoal) != 0 && !(st & SquareType::kBox)) unsolved = true;
+      for (int dir : dirs) {
+        int next = solt + dir;
+        if (barrier_[next]) {
+          if (std::find(boxes_.begin(), boxes_.end(), next) == boxes_.end()) boxes_.push_back(next);
+          continue;
+        }
+        if (!inside_[next] || component_[next] != -1) continue;
+        component_[next] = start;
+        marked_.push_back(next);
+        squares_.push_back(next);
+      }
+    }
+    if (boxes_.empty()) continue;
+
+    bool pi = true;
+    int count = 0;
+    for (int box : boxes_) {
+      if (!(m.map[box] & SquareType::kGoal)) unsolved = true;
+      for (int dir : dirs) {
+        int dest = box + dir;
+        int from = box - dir;
+        bool destFree = !(m.map[dest] & (SquareType::kWall | SquareType::kBox));
+        bool into = component_[dest] == static_cast<int>(start);
+        if (destFree && reachable(from)) {
+          // I: 能做的推动都要推进 corral
+          if (!into) pi = false;
+          ++count;
+        } else if (destFree && into && !(m.map[from] & SquareType::kWall)) {
+          // P: 推进 corral 的推动玩家暂时做不了(被箱子挡着或者走不到)
+          pi = false;
+        }
+      }
+      if (!pi) break;
+    }
+    if (!pi || !unsolved || count >= bestPushes) continue;
+
+    bestPushes = count;
+    bestSquares_.swap(squares_);
+    bestBoxes_.swap(boxes_);
+  }
+  // 只清这次碰过的格子
+  for (int solt : marked_) component_[solt] = -1;
+  for (int box : m.boxes) barrier_[box] = 0;
+  if (bestPushes == INT_MAX) return false;
+
+  ++corrals_;
+  for (int solt : bestSquares_) best_[solt] = 1;
+  for (int box : bestBoxes_) bestBarrier_[box] = 1;
+  corralBoxes_.clear();
+  for (int box : m.boxes) {
+    if (best_[box] || bestBarrier_[box]) corralBoxes_.push_back(box);
+  }
+  bool deadlock = corralBoxes_.size() <= static_cast<size_t>(kMaxSearchBoxes) &&
+      isDeadlock(m, corralBoxes_, best_);
+  if (deadlock) {
+    ++deadlocks_;
+    pushes.clear();
+  } else {
+    pushes.erase(std::remove_if(pushes.begin(), pushes.end(), [this](const Push& p) {
+      return !bestBarrier_[p.boxSolt];
+    }), pushes.end());
+  }
+  for (int solt : bestSquares_) best_[solt] = 0;
+  for (int box : bestBoxes_) bestBarrier_[box] = 0;
+  return deadlock;
+}
+
+// 只留下 corral 里和边界上的箱子, 其余箱子拿掉, 这是原局面的松弛.
+// 松弛后的局面推不到所有箱子都在目标上就一定是死锁; 玩家走进了 corral 就不再往下证明
+bool CorralPruner::isDeadlock(const Board& m, const std::vector<int>& boxes,
+    const std::vector<char>& inside) {
+  Board& board = *scratch_;
+  DynamicData data;
+  for (int box : boxes) data.boxes.insert(box);
+  data.playerSolt = m.playerSolt;
+  board.recoverFromData(data);
+  Reach reach;
+  calcReachableTiles(board, reach);
+  uint64_t key = board.normalizedZobrist(reach.minReachableSolt).Hash();
+  auto it = cache_.find(key);
+  if (it != cache_.end()) return it->second;
+
+  std::vector<DynamicData> queue(1, data);
+  std::unordered_set<uint64_t> visited;
+  visited.insert(key);
+  std::vector<Push> pushes;
+  bool deadlock = true;
+  for (size_t head = 0; head < queue.size() && deadlock; ++head) {
+    if (head >= static_cast<size_t>(kSearchBudget)) {
+      deadlock = false;
+      break;
+    }
+    board.recoverFromData(queue[head]);
+    Reach current;
+    calcReachableTiles(board, current);
+    bool opened = false;
+    for (size_t solt = 0; solt < inside.size() && !opened; ++solt) {
+      opened = inside[solt] && current.contains(solt);
+    }
+    if (opened || std::all_of(board.boxes.begin(), board.boxes.end(), [&board](int box) {
+          return board.goals.contains(box);
+        })) {
+      deadlock = false;
+      break;
+    }
+
+    pushes.clear();
+    getPushes(board, current, pushes);
+    for (const auto& p : pushes) {
+      if (dl_.isDeadSolt(p.boxSolt + p.dir)) continue;
+      doPush(board, p);
+      Reach next;
+      updateReach(board, current, p, next);
+      if (visited.insert(board.normalizedZobrist(next.minReachableSolt).Hash()).second) {
+        queue.emplace_back();
+        board.extractDynamicData(queue.back());
+      }
+      undoPush(board, p);
+    }
+  }
+  cache_.emplace(key, deadlock);
+  return deadlock;
+}
@@ -0,0 +1,62 @@
+#ifndef WSUN_SOKOBAN_CORRAL_H_
+#define WSUN_SOKOBAN_CORRAL_H_
+
+#include <inttypes.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+struct Board;
+struct Reach;
+struct Push;
+class DeadLock;
+
+// PI-corral 剪枝.
+// corral 是玩家走不到, 被箱子围起来的区域, 挨着玩家区域的那些箱子是它的边界.
+// 边界箱子的每个合法推动都只能推进 corral(I), 并且所有能推进 corral 的推动玩家都能做(P),
+// 这样的 corral 里还有没解决的箱子或目标时, 早晚要推边界箱子进去, 先推也不会丢解,
+// 所以只生成边界箱子的推动.
+class CorralPruner {
+ public:
+  // 判定死锁的子搜索最多访问的局面数, 超过就当作不是死锁
+  static const int kSearchBudget = 200;
+  // 箱子(含边界)多于这个数的 corral 不做死锁判定, 只剪枝
+  static const int kMaxSearchBoxes = 8;
+
+  CorralPruner(const DeadLock& dl, const Board& board);
+  ~CorralPruner();
+
+  // pushes 是 getPushes 的结果. 找到 PI-corral 时只保留它边界箱子的推动;
+  // 证明 corral 无解时清空 pushes 并返回 true
+  bool prune(const Board& board, const Reach& reach, std::vector<Push>& pushes);
+
+  uint64_t corrals() const { return corrals_; }
+  uint64_t deadlocks() const { return deadlocks_; }
+
+ private:
+  bool isDeadlock(const Board& board, const std::vector<int>& boxes, const std::vector<char>& inside);
+
+  const DeadLock& dl_;
+  // 子搜索用的棋盘, 只放 corral 里和边界上的箱子
+  std::unique_ptr<Board> scratch_;
+  std::vector<char> inside_;
+  // prune 每次用的按格子排列的标记, 构造时分配一次, 用完只清掉碰过的格子:
+  // 边界箱子, 格子所属 corral 的起点(-1 为未划分), 选中的 corral 和它的边界箱子
+  std::vector<char> barrier_;
+  std::vector<int> component_;
+  std::vector<char> best_;
+  std::vector<char> bestBarrier_;
+  // 同样复用容量的列表: 当前 corral 的格子和边界箱子, 选中的那个, 本次划分过的格子, 子搜索的箱子
+  std::vector<int> squares_;
+  std::vector<int> boxes_;
+  std::vector<int> bestSquares_;
+  std::vector<int> bestBoxes_;
+  std::vector<int> marked_;
+  std::vector<int> corralBoxes_;
+  // 子搜索起点局面 -> 是否死锁
+  std::unordered_map<uint64_t, bool> cache_;
+  uint64_t corrals_ = 0;
+  uint64_t deadlocks_ = 0;
+};
+
+#endif // #ifndef WSUN_SOKOBAN_CORRAL_H_
@@ -7,48 +7,45 @@
 
 void DeadLock::generate(const Board& m) {
   distanceGoals_.clear();
-  kDirection[Up] = -m.file;
-  kDirection[Down] = m.file;
+  const SolverContext& ctx = *m.context;
+  const int wall = ctx.wall();
   for (auto goal : m.goals) {
     std::vector<int>& path = distanceGoals_[goal];
-    path.resize(m.map.size(), INT_MAX);
-    path[goal] = 0;
+    path.assign(ctx.cells(), INT_MAX);
+    path[ctx.cellOf[goal]] = 0;
 
+    // 倒着拉: 箱子从 current 退到邻格 boxCell, 玩家要站在再往外一格
     std::queue<int> frontier;
-    frontier.push(goal);
+    frontier.push(ctx.cellOf[goal]);
     while (!frontier.empty()) {
       int current = frontier.front();
       frontier.pop();
-      for (auto dir : kDirection)
+      for (int d = 0; d < 4; ++d)
       {
-        int boxSolt = current + dir;
-        int playerSolt = boxSolt + dir;
+        int boxCell = ctx.neighbors[current][d];
+        int playerCell = ctx.neighbors[boxCell][d];
+        if (boxCell == wall || playerCell == wall) continue;
 
-        bool visited = path[boxSolt] != INT_MAX;
+        bool visited = path[boxCell] != INT_MAX;
         if (visited) continue;
 
-        if (!(m.map[boxSolt] & SquareType::kWall) &&
-            !(m.map[playerSolt] & SquareType::kWall)) {
-          path[boxSolt] = path[current] + 1; 
-          frontier.push(boxSolt);
-        }
+        path[boxCell] = path[current] + 1; 
+        frontier.push(boxCell);
       }
     }
   }
 
   deadblocks_.clear();
-  for (size_t i = 0; i < m.map.size(); ++i)
+  for (int cell = 0; cell < ctx.cells(); ++cell)
   {
-    if (m.map[i] & (SquareType::kWall | SquareType::kEmpty)) continue;
-
     auto it = std::find_if(distanceGoals_.begin(), distanceGoals_.end(),
-        [i](const std::pair<int, std::vector<int>>& e) {
-          return e.second.at(i) != INT_MAX;
+        [cell](const std::pair<int, std::vector<int>>& e) {
+          return e.second[cell] != INT_MAX;
         });
     bool unreachable = it == distanceGoals_.end();
 
     // find dead pos
-    if (unreachable) deadblocks_.insert(i);
+    if (unreachable) deadblocks_.insert(ctx.solts[cell]);
   }
 }
 
@@ -56,6 +53,76 @@ bool DeadLock::isDeadSolt(int pos) const {
   return deadblocks_.find(pos) != deadblocks_.end();
 }
 
+struct DeadLock::FreezeCheck {
+  // 当前递归路径上的箱子当作墙, 避免互相依赖时无限递归
+  std::array<int, kMaxBoxes> walls;
+  int count = 0;
+  // 递归次数上限, 超过就当作没有冻结, 保证每次推动的检查开销有界
+  int budget = 64;
+
+  bool isWall(const Board& m, int solt) const {
+    return (m.map[solt] & SquareType::kWall) ||
+      std::find(walls.begin(), walls.begin() + count, solt) != walls.begin() + count;
+  }
+};
+
+// 包含 boxSolt 的四个 2x2 方块里, 只要有一个全是墙或箱子并且有箱子不在目标上就是死局
+bool DeadLock::isSquareDeadlock(const Board& m, int boxSolt) const {
+  static const int kCorners[4][2] = { { -1, -1 }, { -1, 1 }, { 1, -1 }, { 1, 1 } };
+  for (const auto& corner : kCorners) {
+    int dx = corner[1];
+    int dy = corner[0] * m.file;
+    int solts[4] = { boxSolt, boxSolt + dx, boxSolt + dy, boxSolt + dx + dy };
+    bool blocked = true;
+    bool offGoal = false;
+    for (int solt : solts) {
+      SquareType st = m.map[solt];
+      if (!(st & (SquareType::kWall | SquareType::kBox))) {
+        blocked = false;
+        break;
+      }
+      if ((st & SquareType::kBox) && !(st & SquareType::kGoal)) offGoal = true;
+    }
+    if (blocked && offGoal) return true;
+  }
+  return false;
+}
+
+// offGoal 返回冻结的这一组箱子里是否有不在目标上的
+bool DeadLock::isFrozen(const Board& m, int boxSolt, FreezeCheck& check, bool& offGoal) const {
+  if (check.count == kMaxBoxes || --check.budget < 0) return false;
+  check.walls[check.count++] = boxSolt;
+  offGoal = !(m.map[boxSolt] & SquareType::kGoal);
+
+  // 水平和竖直两个方向都推不动才算冻结
+  bool frozen = true;
+  for (int axis = 0; axis < 2 && frozen; ++axis) {
+    int dir = axis == 0 ? 1 : m.file;
+    int prev = boxSolt - dir;
+    int next = boxSolt + dir;
+    bool blocked = check.isWall(m, prev) || check.isWall(m, next) ||
+      (isDeadSolt(prev) && isDeadSolt(next));
+    bool neighborOffGoal = false;
+    if (!blocked && (m.map[prev] & SquareType::kBox)) {
+      blocked = isFrozen(m, prev, check, neighborOffGoal);
+    }
+    if (!blocked && (m.map[next] & SquareType::kBox)) {
+      blocked = isFrozen(m, next, check, neighborOffGoal);
+    }
+    offGoal = offGoal || (blocked && neighborOffGoal);
+    frozen = blocked;
+  }
+  --check.count;
+  return frozen;
+}
+
+bool DeadLock::isFreezeDeadlock(const Board& m, int boxSolt) const {
+  if (isSquareDeadlock(m, boxSolt)) return true;
+  FreezeCheck check;
+  bool offGoal = false;
+  return isFrozen(m, boxSolt, check, offGoal) && offGoal;
+}
+
 const std::unordered_map<int, std::vector<int>>&
 DeadLock::distanceGoals() const {
   return distanceGoals_;
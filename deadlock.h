@@ -2,6 +2,7 @@
 #define WSUN_SOKOBAN_DEADLOCK_H_
 
 #include "types.h"
+#include "boxset.h"
 #include <unordered_map>
 #include <unordered_set>
 
@@ -13,10 +14,18 @@ class DeadLock {
 
   void generate(const Board& board);
   bool isDeadSolt(int pos) const;
+  // 刚被推到 boxSolt 的箱子是否和周围的墙/箱子一起被冻结(含2x2方块), 且其中有箱子不在目标上.
+  // 只检查被推箱子附近, 开销与箱子总数无关
+  bool isFreezeDeadlock(const Board& board, int boxSolt) const;
+  // 目标格子 -> 箱子从各内部格子(按 SolverContext 的编号)推到该目标的最少推动次数
   const std::unordered_map<int, std::vector<int>>& distanceGoals() const;
   const std::unordered_set<int>& deadBlocks() const;
 
  private:
+  struct FreezeCheck;
+  bool isSquareDeadlock(const Board& board, int boxSolt) const;
+  bool isFrozen(const Board& board, int boxSolt, FreezeCheck& check, bool& offGoal) const;
+
   std::unordered_map<int, std::vector<int>> distanceGoals_;
   std::unordered_set<int> deadblocks_;
 };
@@ -0,0 +1,411 @@
+#ifndef WSUN_SOKOBAN_EXTERNAL_H
+#define WSUN_SOKOBAN_EXTERNAL_H
+
+#include "solver.h"
+#include <unistd.h>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+// 外存分层搜索.
+// 按推动次数一层一层做宽度优先搜索, 每层和已访问集合都是磁盘上按局面排序的定长记录文件.
+// 展开时子局面先攒在内存里, 满了就排序去重写成一个 run; 一层展开完之后把所有 run 和
+// 已访问集合一起流式归并, 去掉重复局面得到下一层(延迟重复检测), 不需要随机查找.
+// 找到目标后从最后一层往前逐层扫描, 找出能推到当前局面的父局面, 还原推动序列.
+namespace external {
+
+// 记录: 箱子格子升序排列, 最后一格是玩家所在区域的最小格子. 一关的箱子数固定, 所以记录定长
+typedef uint16_t Cell;
+
+static int compare(const Cell* l, const Cell* r, int width) {
+  for (int i = 0; i < width; ++i) {
+    if (l[i] != r[i]) return l[i] < r[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+static void pack(const Board& board, int minReachableSolt, Cell* record) {
+  int i = 0;
+  for (int box : board.boxes) record[i++] = box;
+  record[i] = minReachableSolt;
+}
+
+static void unpack(const Cell* record, int width, DynamicData& data) {
+  data.boxes.clear();
+  for (int i = 0; i < width - 1; ++i) data.boxes.insert(record[i]);
+  data.playerSolt = record[width - 1];
+}
+
+// 管理临时目录里的文件, 统计占用的磁盘空间, 结束时删除所有文件
+class Scratch {
+ public:
+  Scratch(const std::string& dir, size_t limitBytes)
+    : dir_(dir.empty() ? "." : dir),
+      limitBytes_(limitBytes) {}
+
+  ~Scratch() {
+    for (const auto& file : files_) std::remove(file.first.c_str());
+  }
+
+  std::string create() {
+    std::string path = dir_ + "/sokoban-" + std::to_string(getpid()) + "-" +
+      std::to_string(next_++) + ".run";
+    files_[path] = 0;
+    return path;
+  }
+
+  void grow(const std::string& path, size_t bytes) {
+    files_[path] += bytes;
+    usedBytes_ += bytes;
+    peakBytes_ = std::max(peakBytes_, usedBytes_);
+  }
+
+  void remove(const std::string& path) {
+    auto it = files_.find(path);
+    if (it == files_.end()) return;
+    usedBytes_ -= it->second;
+    files_.erase(it);
+    std::remove(path.c_str());
+  }
+
+  void fail() { failed_ = true; }
+  bool failed() const { return failed_; }
+  bool full() const { return limitBytes_ != 0 && usedBytes_ > limitBytes_; }
+  size_t usedBytes() const { return usedBytes_; }
+  size_t peakBytes() const { return peakBytes_; }
+
+ private:
+  std::string dir_;
+  size_t limitBytes_;
+  std::map<std::string, size_t> files_;
+  size_t usedBytes_ = 0;
+  size_t peakBytes_ = 0;
+  uint64_t next_ = 0;
+  bool failed_ = false;
+};
+
+static const size_t kIoBufferBytes = 1 << 20;
+
+class RunWriter {
+ public:
+  RunWriter(Scratch& scratch, const std::string& path, int width)
+    : scratch_(scratch),
+      path_(path),
+      width_(width),
+      file_(std::fopen(path.c_str(), "wb")) {
+    if (file_ == nullptr) {
+      scratch_.fail();
+      return;
+    }
+    std::setvbuf(file_, nullptr, _IOFBF, kIoBufferBytes);
+  }
+
+  ~RunWriter() { close(); }
+
+  void write(const Cell* record) {
+    if (file_ == nullptr) return;
+    if (std::fwrite(record, sizeof(Cell), width_, file_) != static_cast<size_t>(width_)) {
+      scratch_.fail();
+    }
+    scratch_.grow(path_, width_ * sizeof(Cell));
+    ++count_;
+  }
+
+  void close() {
+    if (file_ == nullptr) return;
+    if (std::fclose(file_) != 0) scratch_.fail();
+    file_ = nullptr;
+  }
+
+  uint64_t count() const { return count_; }
+
+ private:
+  Scratch& scratch_;
+  std::string path_;
+  int width_;
+  FILE* file_;
+  uint64_t count_ = 0;
+};
+
+class RunReader {
+ public:
+  RunReader(const std::string& path, int width)
+    : width_(width),
+      record_(width),
+      file_(std::fopen(path.c_str(), "rb")) {
+    if (file_ != nullptr) std::setvbuf(file_, nullptr, _IOFBF, kIoBufferBytes);
+  }
+
+  ~RunReader() {
+    if (file_ != nullptr) std::fclose(file_);
+  }
+
+  bool next() {
+    valid_ = file_ != nullptr &&
+      std::fread(record_.data(), sizeof(Cell), width_, file_) == static_cast<size_t>(width_);
+    return valid_;
+  }
+
+  bool valid() const { return valid_; }
+  const Cell* record() const { return record_.data(); }
+
+ private:
+  int width_;
+  std::vector<Cell> record_;
+  FILE* file_;
+  bool valid_ = false;
+};
+
+// 内存里攒子局面的缓冲区, 满了排序去重后整块写成一个 run
+class RunBuffer {
+ public:
+  RunBuffer(int width, size_t bytes)
+    : width_(width),
+      capacity_(std::max<size_t>(1, bytes / (width * sizeof(Cell) + sizeof(uint32_t)))) {
+    records_.reserve(capacity_ * width_);
+    order_.reserve(capacity_);
+  }
+
+  bool full() const { return order_.size() >= capacity_; }
+  bool empty() const { return order_.empty(); }
+  size_t memoryBytes() const { return capacity_ * (width_ * sizeof(Cell) + sizeof(uint32_t)); }
+
+  void add(const Cell* record) {
+    order_.push_back(order_.size());
+    records_.insert(records_.end(), record, record + width_);
+  }
+
+  void flush(Scratch& scratch, std::vector<std::string>& runs) {
+    if (empty()) return;
+    const Cell* base = records_.data();
+    int width = width_;
+    std::sort(order_.begin(), order_.end(), [base, width](uint32_t l, uint32_t r) {
+      return compare(base + l * width, base + r * width, width) < 0;
+    });
+    runs.push_back(scratch.create());
+    RunWriter writer(scratch, runs.back(), width_);
+    const Cell* last = nullptr;
+    for (uint32_t i : order_) {
+      const Cell* record = base + i * width_;
+      if (last != nullptr && compare(last, record, width_) == 0) continue;
+      writer.write(record);
+      last = record;
+    }
+    records_.clear();
+    order_.clear();
+  }
+
+ private:
+  int width_;
+  size_t capacity_;
+  std::vector<Cell> records_;
+  std::vector<uint32_t> order_;
+};
+
+// 把这一层展开出来的 run 和已访问集合一起归并: 去掉 run 之间的重复和已经访问过的局面,
+// 新局面写到 layer, 已访问集合和新局面合并写到 nextClosed. 全程只有顺序读写
+static void mergeLayer(const std::vector<std::string>& runs, const std::string& closed,
+    RunWriter& layer, RunWriter& nextClosed, int width) {
+  std::vector<std::unique_ptr<RunReader>> readers;
+  for (const auto& run : runs) {
+    readers.emplace_back(new RunReader(run, width));
+    readers.back()->next();
+  }
+  auto greater = [&readers, width](int l, int r) {
+    return compare(readers[l]->record(), readers[r]->record(), width) > 0;
+  };
+  std::priority_queue<int, std::vector<int>, decltype(greater)> heap(greater);
+  for (size_t i = 0; i < readers.size(); ++i) {
+    if (readers[i]->valid()) heap.push(i);
+  }
+
+  RunReader old(closed, width);
+  old.next();
+  std::vector<Cell> last(width);
+  bool hasLast = false;
+  while (!heap.empty()) {
+    int top = heap.top();
+    heap.pop();
+    const Cell* record = readers[top]->record();
+    if (!hasLast || compare(record, last.data(), width) != 0) {
+      std::copy(record, record + width, last.begin());
+      hasLast = true;
+      while (old.valid() && compare(old.record(), record, width) < 0) {
+        nextClosed.write(old.record());
+        old.next();
+      }
+      if (!old.valid() || compare(old.record(), record, width) != 0) {
+        layer.write(record);
+        nextClosed.write(record);
+      }
+    }
+    if (readers[top]->next()) heap.push(top);
+  }
+  for (; old.valid(); old.next()) nextClosed.write(old.record());
+}
+
+} // namespace external
+
+static SearchResult externalSearch(Board& board, const SearchOptions& options = SearchOptions()) {
+  using namespace external;
+  uint64_t startTime = getNowTime();
+  SearchResult result;
+  DeadLock dl;
+  dl.generate(board);
+  const Board start(board);
+  Heuristic heuristic(options.heuristic, dl, board);
+  heuristic.reset(board);
+  if (heuristic.value() == Heuristic::kDeadlock) return result;
+  board.heuristic = &heuristic;
+  CorralPruner corrals(dl, board);
+
+  const int width = board.boxes.size() + 1;
+  Scratch scratch(options.scratchDir, options.diskLimitBytes);
+  size_t bufferBytes = options.memoryLimitBytes != 0 ? options.memoryLimitBytes / 2 : kDefaultRunBufferBytes;
+  RunBuffer buffer(width, bufferBytes);
+  result.peakMemoryBytes = buffer.memoryBytes();
+
+  std::vector<Cell> record(width);
+  std::vector<Cell> goal(width);
+  std::vector<std::string> layers;
+  std::string closed;
+  {
+    Reach reach;
+    calcReachableTiles(board, reach);
+    pack(board, reach.minReachableSolt, record.data());
+    layers.push_back(scratch.create());
+    closed = scratch.create();
+    RunWriter(scratch, layers.back(), width).write(record.data());
+    RunWriter(scratch, closed, width).write(record.data());
+  }
+  if (checkGameOver(board)) {
+    board.heuristic = nullptr;
+    result.status = SearchStatus::kSolved;
+    return result;
+  }
+
+  DynamicData data;
+  Reach reach;
+  Reach next;
+  std::vector<Push> pushes;
+  std::vector<std::string> runs;
+  bool found = false;
+  bool stopped = false;
+  while (!found && !stopped) {
+    RunReader reader(layers.back(), width);
+    while (reader.next()) {
+      if ((result.explorNodes & 1023) == 0 && options.timeLimitMs != 0 &&
+          (getNowTime() - startTime) / 1000000 > options.timeLimitMs) {
+        result.status = SearchStatus::kTimeLimit;
+        stopped = true;
+        break;
+      }
+      ++result.explorNodes;
+      unpack(reader.record(), width, data);
+      board.recoverFromData(data);
+      calcReachableTiles(board, reach);
+      pushes.clear();
+      getPushes(board, reach, pushes);
+      if (corrals.prune(board, reach, pushes)) ++result.corralNodes;
+      for (const auto& p : pushes) {
+        ++result.generateNodes;
+        if (dl.isDeadSolt(p.boxSolt + p.dir)) continue;
+        doPush(board, p);
+        if (dl.isFreezeDeadlock(board, p.boxSolt + p.dir)) {
+          ++result.frozenNodes;
+        } else if (heuristic.value() == Heuristic::kDeadlock) {
+          ++result.deadlockNodes;
+        } else {
+          updateReach(board, reach, p, next);
+          pack(board, next.minReachableSolt, record.data());
+          if (checkGameOver(board)) {
+            goal = record;
+            found = true;
+          }
+          buffer.add(record.data());
+          if (buffer.full()) buffer.flush(scratch, runs);
+        }
+        undoPush(board, p);
+        if (found) break;
+      }
+      if (found || scratch.full() || scratch.failed()) break;
+    }
+    if (found || stopped) break;
+    if (scratch.full() || scratch.failed()) {
+      result.status = SearchStatus::kDiskLimit;
+      break;
+    }
+
+    buffer.flush(scratch, runs);
+    std::string layer = scratch.create();
+    std::string nextClosed = scratch.create();
+    uint64_t count = 0;
+    {
+      RunWriter layerWriter(scratch, layer, width);
+      RunWriter closedWriter(scratch, nextClosed, width);
+      mergeLayer(runs, closed, layerWriter, closedWriter, width);
+      count = layerWriter.count();
+    }
+    for (const auto& run : runs) scratch.remove(run);
+    runs.clear();
+    scratch.remove(closed);
+    closed = nextClosed;
+    layers.push_back(layer);
+    if (scratch.full() || scratch.failed()) {
+      result.status = SearchStatus::kDiskLimit;
+      break;
+    }
+    if (options.verbose) {
+      printf("layer %zu: %lu states, disk %zu MB, spent time: %lu ms\n", layers.size() - 1, count,
+          scratch.usedBytes() >> 20, (getNowTime() - startTime) / 1000000);
+    }
+    if (count == 0) break;
+  }
+
+  if (found) {
+    // 目标在第 layers.size() 层, 逐层往前找能一步推到 goal 的局面. 这里不剪枝,
+    // 只要推得到 goal 的父局面都可以
+    result.status = SearchStatus::kSolved;
+    for (size_t depth = layers.size(); depth-- > 0;) {
+      RunReader reader(layers[depth], width);
+      bool matched = false;
+      while (!matched && reader.next()) {
+        unpack(reader.record(), width, data);
+        board.recoverFromData(data);
+        calcReachableTiles(board, reach);
+        pushes.clear();
+        getPushes(board, reach, pushes);
+        for (const auto& p : pushes) {
+          doPush(board, p);
+          updateReach(board, reach, p, next);
+          pack(board, next.minReachableSolt, record.data());
+          undoPush(board, p);
+          if (compare(record.data(), goal.data(), width) == 0) {
+            result.pushes.push_back(p);
+            matched = true;
+            break;
+          }
+        }
+      }
+      assert(matched);
+      std::copy(reader.record(), reader.record() + width, goal.begin());
+    }
+    std::reverse(result.pushes.begin(), result.pushes.end());
+    expandToMoves(start, result.pushes, result.moves);
+  }
+  board.heuristic = nullptr;
+  board.recoverFromData(DynamicData{ start.boxes, start.playerSolt });
+  result.timeMs = (getNowTime() - startTime) / 1000000;
+  if (options.verbose) {
+    printf("%s in external search\n", result.solved() ? "find best way" : statusName(result.status));
+    printf("generateNodes: %lu, explorNodes: %lu, deadlockNodes: %lu, frozenNodes: %lu, corralNodes: %lu, spent time: %lu ms\n",
+        result.generateNodes, result.explorNodes, result.deadlockNodes, result.frozenNodes,
+        result.corralNodes, result.timeMs);
+    printf("layers: %zu, peak disk: %zu MB, run buffer: %zu MB\n", layers.size(),
+        scratch.peakBytes() >> 20, buffer.memoryBytes() >> 20);
+  }
+  return result;
+}
+
+#endif
@@ -0,0 +1,166 @@
+#include "heuristic.h"
+#include "deadlock.h"
+#include "solver.h"
+#include <climits>
+#include <algorithm>
+
+namespace {
+
+// 不可达的边用一个足够大的有限值代替, 避免匈牙利算法里溢出
+const int kInf = 1 << 20;
+// 每次 kInf 量级的增广都把 v 往下压一截, 最小的 v 低于它就整体平移回来.
+// 一次增广最多移动 size_ * kInf, 离 INT_MIN 还远
+const int kNormalizeBound = -(1 << 24);
+
+} // namespace
+
+Heuristic::Heuristic(HeuristicType type, const DeadLock& dl, const Board& board)
+  : type_(type),
+    size_(board.goals.size()),
+    total_(0),
+    augments_(0) {
+  assert(board.boxes.size() == board.goals.size());
+  int cells = board.context->cells();
+  cost_.resize(static_cast<size_t>(cells) * size_);
+  int j = 0;
+  for (int goal : board.goals) {
+    const std::vector<int>& path = dl.distanceGoals().at(goal);
+    for (int cell = 0; cell < cells; ++cell) {
+      cost_[cell * size_ + j] = path[cell] == INT_MAX ? kInf : path[cell];
+    }
+    ++j;
+  }
+  u_.resize(size_ + 1);
+  v_.resize(size_ + 1);
+  match_.resize(size_ + 1);
+  way_.resize(size_ + 1);
+  minv_.resize(size_ + 1);
+  used_.resize(size_ + 1);
+  boxes_.resize(size_ + 1);
+  goalOf_.resize(size_ + 1);
+  rowCost_.resize(size_ + 1);
+  rowAt_.resize(cells);
+}
+
+void Heuristic::reset(const Board& board) {
+  if (type_ == HeuristicType::kManhattan) {
+    total_ = static_cast<int>(costForManhattan(board));
+    return;
+  }
+
+  std::fill(rowAt_.begin(), rowAt_.end(), 0);
+  int row = 0;
+  for (int box : board.boxes) {
+    int cell = board.context->cellOf[box];
+    boxes_[++row] = cell;
+    rowAt_[cell] = row;
+  }
+  std::fill(u_.begin(), u_.end(), 0);
+  std::fill(v_.begin(), v_.end(), 0);
+  std::fill(match_.begin(), match_.end(), 0);
+  for (int i = 1; i <= size_; ++i) {
+    augment(i);
+  }
+  updateAssignment();
+}
+
+void Heuristic::moveBox(const Board& board, int from, int to) {
+  if (type_ == HeuristicType::kManhattan) {
+    total_ = static_cast<int>(costForManhattan(board));
+    return;
+  }
+
+  from = board.context->cellOf[from];
+  to = board.context->cellOf[to];
+  int row = rowAt_[from];
+  rowAt_[from] = 0;
+  rowAt_[to] = row;
+  boxes_[row] = to;
+
+  // 只有这一行的代价变了, 把 u 调到该行的最小约化代价, 其余行的对偶可行性不受影响
+  const int* costs = costRow(to);
+  int best = INT_MAX;
+  for (int j = 1; j <= size_; ++j) {
+    best = std::min(best, costs[j - 1] - v_[j]);
+  }
+  u_[row] = best;
+
+  int goal = goalOf_[row];
+  int cost = costs[goal - 1];
+  if (cost - v_[goal] == best) {
+    total_ += cost - rowCost_[row];
+    rowCost_[row] = cost;
+    return;
+  }
+
+  match_[goal] = 0;
+  augment(row);
+  normalize();
+  updateAssignment();
+  ++augments_;
+}
+
+int Heuristic::value() const {
+  return total_ >= kInf ? kDeadlock : total_;
+}
+
+// 匈牙利算法的一个阶段: 其余行已经匹配且对偶可行, 为 row 找一条增广路
+void Heuristic::augment(int row) {
+  match_[0] = row;
+  int j0 = 0;
+  std::fill(minv_.begin(), minv_.end(), INT_MAX);
+  std::fill(used_.begin(), used_.end(), false);
+  do {
+    used_[j0] = true;
+    int i0 = match_[j0];
+    const int* costs = costRow(boxes_[i0]);
+    int delta = INT_MAX;
+    int j1 = 0;
+    for (int j = 1; j <= size_; ++j) {
+      if (used_[j]) continue;
+      int cur = costs[j - 1] - u_[i0] - v_[j];
+      if (cur < minv_[j]) {
+        minv_[j] = cur;
+        way_[j] = j0;
+      }
+      if (minv_[j] < delta) {
+        delta = minv_[j];
+        j1 = j;
+      }
+    }
+    for (int j = 0; j <= size_; ++j) {
+      if (used_[j]) {
+        u_[match_[j]] += delta;
+        v_[j] -= delta;
+      } else {
+        minv_[j] -= delta;
+      }
+    }
+    j0 = j1;
+  } while (match_[j0] != 0);
+  do {
+    int j1 = way_[j0];
+    match_[j0] = match_[j1];
+    j0 = j1;
+  } while (j0 != 0);
+}
+
+// 所有 v 加上同一个数, 所有 u 减去它, 约化代价 cost - u - v 不变, 分配和估值都不受影响.
+// v_[0] 是哨兵列, 每次增广都被压低却从不参与约化代价, 每次直接归零
+void Heuristic::normalize() {
+  v_[0] = 0;
+  int low = *std::min_element(v_.begin() + 1, v_.end());
+  if (low >= kNormalizeBound) return;
+  for (int j = 1; j <= size_; ++j) v_[j] -= low;
+  for (int i = 1; i <= size_; ++i) u_[i] += low;
+}
+
+void Heuristic::updateAssignment() {
+  total_ = 0;
+  for (int j = 1; j <= size_; ++j) {
+    int row = match_[j];
+    goalOf_[row] = j;
+    rowCost_[row] = costRow(boxes_[row])[j - 1];
+    total_ += rowCost_[row];
+  }
+}
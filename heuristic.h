@@ -0,0 +1,63 @@
+#ifndef WSUN_SOKOBAN_HEURISTIC_H_
+#define WSUN_SOKOBAN_HEURISTIC_H_
+
+#include "types.h"
+#include <vector>
+
+enum class HeuristicType {
+  kManhattan,  // 排序后第i个箱子对第i个目标的曼哈顿距离之和
+  kMatching    // 箱子到目标推动距离的最小权完美匹配
+};
+
+struct Board;
+class DeadLock;
+// 挂在 Board 上随 doPush/undoPush 增量维护的估值.
+// 匹配估值保存当前的分配和对偶变量, 一次推动只改变一个箱子(匈牙利算法里的一行),
+// 只要被推箱子原来分到的目标仍是该行的最优列, 分配不变, 估值 O(n) 更新;
+// 否则只对这一行重新做一次增广, 不用整体重算.
+class Heuristic {
+ public:
+  // 估值为无穷大, 即某个箱子无法分配到任何目标, 局面已死
+  static const int kDeadlock = -1;
+
+  Heuristic(HeuristicType type, const DeadLock& dl, const Board& board);
+
+  // 对 board 整体重算
+  void reset(const Board& board);
+  // board 上的一个箱子已经从 from 移到 to
+  void moveBox(const Board& board, int from, int to);
+  int value() const;
+
+  HeuristicType type() const { return type_; }
+  uint64_t augments() const { return augments_; }
+
+ private:
+  void augment(int row);
+  void normalize();
+  void updateAssignment();
+
+  HeuristicType type_;
+  int size_;
+  // 箱子在 cell 时推到第 goal 个目标的最少推动次数. 按内部格子编号排, 一个格子的一行连续存放,
+  // 推动后重算一行只读一段相邻的内存
+  const int* costRow(int cell) const { return &cost_[cell * size_]; }
+  std::vector<int> cost_;
+
+  // 匈牙利算法的对偶变量和匹配结果, 下标从1开始, 0为哨兵
+  std::vector<int> u_;
+  std::vector<int> v_;
+  std::vector<int> match_;    // match_[goal] = row
+  std::vector<int> way_;
+  std::vector<int> minv_;
+  std::vector<char> used_;
+
+  // 每个箱子(行)当前所在格子的编号, 分到的目标和这一项的代价
+  std::vector<int> boxes_;
+  std::vector<int> goalOf_;
+  std::vector<int> rowCost_;
+  std::vector<int> rowAt_;    // rowAt_[cell] = row, 没有箱子为0
+  int total_;
+  uint64_t augments_;
+};
+
+#endif // #ifndef WSUN_SOKOBAN_HEURISTIC_H_
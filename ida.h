@@ -0,0 +1,160 @@
+#ifndef WSUN_SOKOBAN_IDA_H
+#define WSUN_SOKOBAN_IDA_H
+
+#include "solver.h"
+#include <deque>
+
+// 迭代加深 A* (IDA*).
+// 只在一个 Board 上原地 doPush/undoPush 做深度优先搜索, 除了固定大小的置换表
+// 和按深度复用的推法数组之外不再占用内存, 可以长时间运行而内存不增长.
+// 置换表记录本轮迭代中每个局面第一次到达时的 g, 以不小于它的 g 再次到达时剪掉.
+namespace ida {
+
+struct Context {
+  const SearchOptions& options;
+  const DeadLock& dl;
+  Heuristic& heuristic;
+  TranspositionTable& visited;
+  PatternDatabase& patterns;
+  const MacroMoves& macros;
+  CorralPruner& corrals;
+  SearchResult& result;
+  uint64_t startTime;
+  int threshold;
+  int nextThreshold;
+  bool stopped;
+  // deque 在尾部扩容时不会让已有元素的引用失效
+  std::deque<std::vector<Push>> pushStack;
+  std::vector<Push> path;
+};
+
+// parent 是上一层的 reach, 只推了一次箱子时用来增量计算本层的 reach, 否则为空
+static bool search(Context& ctx, Board& board, int g, const Reach* parent) {
+  int h = ctx.heuristic.value();
+  if (g + h > ctx.threshold) {
+    ctx.nextThreshold = std::min(ctx.nextThreshold, g + h);
+    return false;
+  }
+  if (checkGameOver(board)) return true;
+
+  ++ctx.result.explorNodes;
+  if ((ctx.result.explorNodes & 1023) == 0 && ctx.options.timeLimitMs != 0 &&
+      (getNowTime() - ctx.startTime) / 1000000 > ctx.options.timeLimitMs) {
+    ctx.stopped = true;
+    return false;
+  }
+
+  Reach reach;
+  if (parent != nullptr) {
+    updateReach(board, *parent, ctx.path.back(), reach);
+  } else {
+    calcReachableTiles(board, reach);
+  }
+  if (!ctx.visited.insert(board.normalizedZobrist(reach.minReachableSolt), g)) {
+    return false;
+  }
+
+  if (ctx.pushStack.size() <= static_cast<size_t>(g)) ctx.pushStack.resize(g + 1);
+  std::vector<Push>& pushes = ctx.pushStack[g];
+  pushes.clear();
+  getPushes(board, reach, pushes);
+  if (ctx.corrals.prune(board, reach, pushes)) ++ctx.result.corralNodes;
+  bool expanded = false;
+  for (const auto& p : pushes) {
+    ++ctx.result.generateNodes;
+    if (ctx.dl.isDeadSolt(p.boxSolt + p.dir)) continue;
+    // 宏推动的后续推动直接追加在 path 上, 剪枝或回溯时一起撤销
+    size_t mark = ctx.path.size();
+    doPush(board, p);
+    ctx.path.push_back(p);
+    ctx.macros.extend(board, p, ctx.path);
+    int dest = ctx.path.back().boxSolt + ctx.path.back().dir;
+    if (ctx.dl.isFreezeDeadlock(board, dest)) {
+      ++ctx.result.frozenNodes;
+    } else if (ctx.patterns.isDeadlock(board, dest)) {
+      ++ctx.result.patternNodes;
+    } else if (ctx.heuristic.value() == Heuristic::kDeadlock) {
+      ++ctx.result.deadlockNodes;
+    } else {
+      expanded = true;
+      int pushed = ctx.path.size() - mark;
+      if (search(ctx, board, g + pushed, pushed == 1 ? &reach : nullptr)) return true;
+    }
+    while (ctx.path.size() > mark) {
+      undoPush(board, ctx.path.back());
+      ctx.path.pop_back();
+    }
+    if (ctx.stopped) return false;
+  }
+  // 所有推法都被死锁检测剪掉, 局面无解, 从最后推动的箱子周围学习死锁模式
+  if (!expanded && !ctx.path.empty()) {
+    ctx.patterns.learn(board, ctx.path.back().boxSolt + ctx.path.back().dir);
+  }
+  return false;
+}
+
+} // namespace ida
+
+static SearchResult idaSearch(Board& board, const SearchOptions& options = SearchOptions()) {
+  uint64_t startTime = getNowTime();
+  SearchResult result;
+  DeadLock dl;
+  dl.generate(board);
+  const Board start(board);
+  Heuristic heuristic(options.heuristic, dl, board);
+  heuristic.reset(board);
+  if (heuristic.value() == Heuristic::kDeadlock) return result;
+  board.heuristic = &heuristic;
+
+  TranspositionTable visited(options.transpositionBytes, positionBound(board, dl));
+  PatternDatabase patterns;
+  if (options.patterns != nullptr) patterns.copyFrom(*options.patterns);
+  MacroMoves macros;
+  macros.generate(board, dl);
+  CorralPruner corrals(dl, board);
+  ida::Context ctx{ options, dl, heuristic, visited, patterns, macros, corrals, result, startTime,
+    heuristic.value(), INT_MAX, false, {}, {} };
+  while (true) {
+    ctx.nextThreshold = INT_MAX;
+    visited.clear();
+    bool solved = ida::search(ctx, board, 0, nullptr);
+    // 置换表在迭代中按需扩容, 每轮结束后取样
+    result.peakMemoryBytes = std::max(result.peakMemoryBytes, visited.memoryBytes());
+    if (solved) {
+      result.status = SearchStatus::kSolved;
+      break;
+    }
+    if (ctx.stopped) {
+      result.status = SearchStatus::kTimeLimit;
+      break;
+    }
+    if (ctx.nextThreshold == INT_MAX) break;
+    if (options.verbose) {
+      printf("threshold %d done, explorNodes: %lu, spent time: %lu ms\n", ctx.threshold,
+          result.explorNodes, (getNowTime() - startTime) / 1000000);
+    }
+    ctx.threshold = ctx.nextThreshold;
+  }
+  // 找到解时 path 上的推动没有撤销, 把棋盘还原到初始局面
+  for (auto it = ctx.path.rbegin(); it != ctx.path.rend(); ++it) {
+    undoPush(board, *it);
+  }
+  board.heuristic = nullptr;
+  if (options.patterns != nullptr) options.patterns->merge(patterns);
+
+  if (result.solved()) {
+    result.pushes = ctx.path;
+    expandToMoves(start, result.pushes, result.moves);
+  }
+  result.timeMs = (getNowTime() - startTime) / 1000000;
+  if (options.verbose) {
+    printf("%s in IDA* search\n", result.solved() ? "find best way" : statusName(result.status));
+    printf("generateNodes: %lu, explorNodes: %lu, deadlockNodes: %lu, frozenNodes: %lu, patternNodes: %lu, corralNodes: %lu, spent time: %lu ms\n",
+        result.generateNodes, result.explorNodes, result.deadlockNodes, result.frozenNodes, result.patternNodes,
+        result.corralNodes, result.timeMs);
+    printf("deadlock patterns: %zu, sub-searches: %lu\n", patterns.size(), patterns.searches());
+  }
+  return result;
+}
+
+#endif
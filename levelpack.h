@@ -0,0 +1,127 @@
+#ifndef WSUN_SOKOBAN_LEVELPACK_H
+#define WSUN_SOKOBAN_LEVELPACK_H
+
+#include "types.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+// 二进制关卡包.
+// 文件头之后是定长的索引表, 每项记着关卡数据的偏移和宽高; 关卡数据每格一个字节(SquareType).
+// 加载时整个文件 mmap 进来, 只解码用到的关卡, 启动开销和包里有多少关卡无关.
+//
+//   Header  { magic, version, count, reserved }    4 x uint32
+//   Entry   { offset, file, rank } x count          uint32 + 2 x uint16
+//   数据    rank * file 字节 x count
+namespace levelpack {
+
+static const uint32_t kMagic = 0x504b4f53;  // "SOKP"
+static const uint32_t kVersion = 1;
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count;
+  uint32_t reserved;
+};
+
+struct Entry {
+  uint32_t offset;
+  uint16_t file;
+  uint16_t rank;
+};
+
+} // namespace levelpack
+
+class LevelPack {
+ public:
+  LevelPack() = default;
+  LevelPack(const LevelPack&) = delete;
+  LevelPack& operator=(const LevelPack&) = delete;
+
+  ~LevelPack() {
+    if (data_ != nullptr) munmap(const_cast<uint8_t*>(data_), bytes_);
+  }
+
+  // 映射并校验文件头和索引表的大小, 关卡数据在用到时才读. 各项索引是否越界留给 level()
+  // 检查, 打开的开销和包里有多少关卡无关
+  bool open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(levelpack::Header))) {
+      ::close(fd);
+      return false;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) return false;
+    data_ = static_cast<const uint8_t*>(data);
+    bytes_ = st.st_size;
+
+    const levelpack::Header* header = reinterpret_cast<const levelpack::Header*>(data_);
+    if (header->magic != levelpack::kMagic || header->version != levelpack::kVersion ||
+        sizeof(levelpack::Header) + static_cast<size_t>(header->count) * sizeof(levelpack::Entry) > bytes_) {
+      return false;
+    }
+    count_ = header->count;
+    return true;
+  }
+
+  size_t size() const { return count_; }
+
+  // 解码第 index 个关卡(从0开始). 索引项指到文件外面时返回 false
+  bool level(size_t index, Level& level) const {
+    if (index >= count_) return false;
+    const levelpack::Entry& entry = entries()[index];
+    if (static_cast<size_t>(entry.offset) + static_cast<size_t>(entry.file) * entry.rank > bytes_) return false;
+    level.file = entry.file;
+    level.rank = entry.rank;
+    const uint8_t* squares = data_ + entry.offset;
+    level.map.resize(static_cast<size_t>(entry.file) * entry.rank);
+    for (size_t i = 0; i < level.map.size(); ++i) {
+      level.map[i] = static_cast<SquareType>(squares[i]);
+    }
+    return true;
+  }
+
+ private:
+  const levelpack::Entry* entries() const {
+    return reinterpret_cast<const levelpack::Entry*>(data_ + sizeof(levelpack::Header));
+  }
+
+  const uint8_t* data_ = nullptr;
+  size_t bytes_ = 0;
+  uint32_t count_ = 0;
+};
+
+// 把文本关卡转成关卡包. 先写临时文件再改名
+static bool writeLevelPack(const LevelArray& levels, const std::string& path) {
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    levelpack::Header header{ levelpack::kMagic, levelpack::kVersion, static_cast<uint32_t>(levels.size()), 0 };
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint32_t offset = sizeof(header) + levels.size() * sizeof(levelpack::Entry);
+    for (const auto& level : levels) {
+      levelpack::Entry entry{ offset, static_cast<uint16_t>(level.file), static_cast<uint16_t>(level.rank) };
+      out.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+      offset += level.map.size();
+    }
+    std::string squares;
+    for (const auto& level : levels) {
+      squares.assign(level.map.begin(), level.map.end());
+      out.write(squares.data(), squares.size());
+    }
+    if (!out) return false;
+  }
+  return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+#endif
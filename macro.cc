@@ -0,0 +1,249 @@
+#include "macro.h"
+#include "solver.h"
+#include <algorithm>
+#include <cassert>
+#include <map>
+
+// 箱子在 solt 上只能沿 dir 所在的轴移动: 垂直方向两边都是墙
+bool MacroMoves::isTunnel(const Board& m, int solt, Direction dir) const {
+  int side = (dir == 1 || dir == -1) ? file_ : 1;
+  return (m.map[solt - side] & SquareType::kWall) && (m.map[solt + side] & SquareType::kWall);
+}
+
+bool MacroMoves::isCorridor(const Board& m, int solt) const {
+  return isTunnel(m, solt, 1) || isTunnel(m, solt, file_);
+}
+
+// 房间里的箱子正好占着填充顺序的前若干个目标时返回箱子数, 否则返回 -1
+int MacroMoves::filledGoals(const Board& m, int room) const {
+  int count = 0;
+  for (int box : m.boxes) {
+    if (roomOf_[box] == room) ++count;
+  }
+  const GoalRoom& goalRoom = rooms_[room];
+  if (count >= static_cast<int>(goalRoom.order.size())) return -1;
+  for (int i = 0; i < count; ++i) {
+    if (!(m.map[goalRoom.order[i]] & SquareType::kBox)) return -1;
+  }
+  return count;
+}
+
+MacroType MacroMoves::extend(Board& board, const Push& push, std::vector<Push>& pushes) const {
+  int box = push.boxSolt + push.dir;
+  Direction dir = push.dir;
+  for (size_t room = 0; room < rooms_.size(); ++room) {
+    const GoalRoom& goalRoom = rooms_[room];
+    if (goalRoom.entrance != box || goalRoom.entryDir != dir) continue;
+    int filled = filledGoals(board, room);
+    if (filled < 0) break;
+    for (const auto& p : goalRoom.paths[filled]) {
+      doPush(board, Push(p.boxSolt, p.dir, board.playerSolt));
+      pushes.push_back(p);
+    }
+    return kGoalRoomMacro;
+  }
+
+  // 只有箱子和身后的玩家都夹在通道里时才接着推: 这时玩家除了继续推或退回去没有别的事可做,
+  // 中间局面不必展开. 门口或一侧敞开的走廊里箱子可能要停下来, 只做这一次推动
+  MacroType type = kNoMacro;
+  while (!(board.map[box] & SquareType::kGoal) && isTunnel(board, box, dir) &&
+      isTunnel(board, box - dir, dir)) {
+    int next = box + dir;
+    if ((board.map[next] & (SquareType::kWall | SquareType::kBox)) || dl_->isDeadSolt(next)) break;
+    Push p(box, dir, box - dir);
+    doPush(board, Push(box, dir, board.playerSolt));
+    pushes.push_back(p);
+    box = next;
+    type = kTunnelMacro;
+  }
+  return type;
+}
+
+void MacroMoves::expand(int boxSolt, Direction dir, int destSolt, MacroType type,
+    std::vector<Push>& pushes) const {
+  pushes.emplace_back(boxSolt, dir, boxSolt - dir);
+  if (type == kTunnelMacro) {
+    for (int box = boxSolt + dir; box != destSolt; box += dir) {
+      pushes.emplace_back(box, dir, box - dir);
+    }
+  } else if (type == kGoalRoomMacro) {
+    // 和 extend 一样按入口和进入方向找房间, 几个房间共用一个入口时才不会找错
+    for (const auto& room : rooms_) {
+      if (room.entrance != boxSolt + dir || room.entryDir != dir) continue;
+      auto it = std::find(room.order.begin(), room.order.end(), destSolt);
+      assert(it != room.order.end());
+      const auto& path = room.paths[it - room.order.begin()];
+      pushes.insert(pushes.end(), path.begin(), path.end());
+      break;
+    }
+  }
+}
+
+// 从 goal 把箱子拉到入口, 最后一次拉动让玩家退到入口外面一格.
+// 反过来就是从入口把箱子推到 goal 的推动序列. 箱子和玩家都只在房间和入口里活动
+bool MacroMoves::pullOut(const Board& m, int room, const GoalRoom& goalRoom, int goal,
+    const std::vector<char>& filled, std::vector<Push>& path) const {
+  const int dirs[4] = { -1, 1, -file_, file_ };
+  int beyond = goalRoom.entrance - goalRoom.entryDir;
+  auto isFree = [&](int solt, int box) {
+    if (solt == box || filled[solt]) return false;
+    return roomOf_[solt] == room || solt == goalRoom.entrance || solt == beyond;
+  };
+  // 玩家所在区域的最小格子, 作为状态里玩家部分的代表
+  std::vector<int> stack;
+  std::vector<char> seen(m.map.size(), 0);
+  auto regionOf = [&](int player, int box) {
+    std::fill(seen.begin(), seen.end(), 0);
+    stack.assign(1, player);
+    seen[player] = 1;
+    int minSolt = player;
+    while (!stack.empty()) {
+      int solt = stack.back();
+      stack.pop_back();
+      minSolt = std::min(minSolt, solt);
+      for (int dir : dirs) {
+        int next = solt + dir;
+        if (!seen[next] && isFree(next, box)) {
+          seen[next] = 1;
+          stack.push_back(next);
+        }
+      }
+    }
+    return minSolt;
+  };
+
+  struct State {
+    int box;
+    int player;
+    int parent;
+    Push push;
+  };
+  std::vector<State> states;
+  std::map<std::pair<int, int>, int> visited;
+  for (int dir : dirs) {
+    if (!isFree(goal + dir, goal)) continue;
+    int player = regionOf(goal + dir, goal);
+    if (visited.emplace(std::make_pair(goal, player), states.size()).second) {
+      states.push_back(State{ goal, player, -1, Push(0, 0, 0) });
+    }
+  }
+  for (size_t head = 0; head < states.size(); ++head) {
+    int box = states[head].box;
+    regionOf(states[head].player, box);
+    std::vector<char> reachable(seen);
+    for (int dir : dirs) {
+      int player = box + dir;
+      int back = player + dir;
+      if (!reachable[player] || !isFree(back, box)) continue;
+      if (roomOf_[player] != room && player != goalRoom.entrance) continue;
+      // 拉动等价于反向的推动 Push(player, -dir, back)
+      Push push(player, -dir, back);
+      if (player == goalRoom.entrance && back == beyond) {
+        path.clear();
+        path.push_back(push);
+        for (int i = head; states[i].parent != -1; i = states[i].parent) {
+          path.push_back(states[i].push);
+        }
+        return true;
+      }
+      int region = regionOf(back, player);
+      if (visited.emplace(std::make_pair(player, region), states.size()).second) {
+        states.push_back(State{ player, region, static_cast<int>(head), push });
+      }
+    }
+  }
+  return false;
+}
+
+// 倒着求填充顺序: 从填满的房间开始, 每次把离入口最近的一个能拉出去的箱子拉出去.
+// 拉走箱子只会让房间更空, 所以贪心不会漏掉可行的顺序
+bool MacroMoves::packRoom(const Board& m, int room, GoalRoom& goalRoom) const {
+  std::vector<char> filled(m.map.size(), 0);
+  std::vector<int> goals;
+  for (int goal : m.goals) {
+    if (roomOf_[goal] == room) {
+      filled[goal] = 1;
+      goals.push_back(goal);
+    }
+  }
+  std::sort(goals.begin(), goals.end(), [&](int l, int r) {
+    return distance(l, goalRoom.entrance, file_) < distance(r, goalRoom.entrance, file_);
+  });
+
+  std::vector<int> order;
+  std::vector<std::vector<Push>> paths;
+  std::vector<Push> path;
+  while (!goals.empty()) {
+    auto it = goals.begin();
+    for (; it != goals.end(); ++it) {
+      filled[*it] = 0;
+      if (pullOut(m, room, goalRoom, *it, filled, path)) break;
+      filled[*it] = 1;
+    }
+    if (it == goals.end()) return false;
+    order.push_back(*it);
+    paths.push_back(path);
+    goals.erase(it);
+  }
+  goalRoom.order.assign(order.rbegin(), order.rend());
+  goalRoom.paths.assign(paths.rbegin(), paths.rend());
+  return true;
+}
+
+// 目标房间: 从目标出发, 不穿过一格宽的通道能走到的区域. 只有一个入口并且开始时
+// 房间里没有箱子才使用, 否则宏推动不一定可行
+void MacroMoves::generate(const Board& m, const DeadLock& dl) {
+  dl_ = &dl;
+  file_ = m.file;
+  rooms_.clear();
+  roomOf_.assign(m.map.size(), -1);
+  const int dirs[4] = { -1, 1, -file_, file_ };
+
+  std::vector<char> seen(m.map.size(), 0);
+  for (int goal : m.goals) {
+    if (seen[goal] || isCorridor(m, goal)) continue;
+    std::vector<int> squares(1, goal);
+    std::vector<int> entrances;
+    seen[goal] = 1;
+    bool hasBox = false;
+    for (size_t i = 0; i < squares.size(); ++i) {
+      int solt = squares[i];
+      hasBox = hasBox || (m.map[solt] & SquareType::kBox);
+      for (int dir : dirs) {
+        int next = solt + dir;
+        if (m.map[next] & (SquareType::kWall | SquareType::kEmpty)) continue;
+        if (isCorridor(m, next)) {
+          if (std::find(entrances.begin(), entrances.end(), next) == entrances.end()) {
+            entrances.push_back(next);
+          }
+        } else if (!seen[next]) {
+          seen[next] = 1;
+          squares.push_back(next);
+        }
+      }
+    }
+    if (hasBox || entrances.size() != 1) continue;
+
+    GoalRoom room;
+    room.entrance = entrances.front();
+    // 入口挨着房间的格子不止一个时不是单向进入
+    int links = 0;
+    for (int dir : dirs) {
+      if (std::find(squares.begin(), squares.end(), room.entrance + dir) != squares.end()) {
+        room.entryDir = dir;
+        ++links;
+      }
+    }
+    if (links != 1) continue;
+    int beyond = room.entrance - room.entryDir;
+    if (m.map[beyond] & (SquareType::kWall | SquareType::kEmpty)) continue;
+
+    int index = rooms_.size();
+    for (int solt : squares) roomOf_[solt] = index;
+    if (packRoom(m, index, room)) {
+      rooms_.push_back(room);
+    } else {
+      for (int solt : squares) roomOf_[solt] = -1;
+    }
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef WSUN_SOKOBAN_MACRO_H_
+#define WSUN_SOKOBAN_MACRO_H_
+
+#include "types.h"
+#include <inttypes.h>
+#include <stddef.h>
+#include <vector>
+
+struct Board;
+struct Push;
+class DeadLock;
+
+enum MacroType : uint8_t {
+  kNoMacro,
+  // 箱子推进通道后一直推到通道出口
+  kTunnelMacro,
+  // 箱子推到目标房间入口后直接推到房间里下一个该填的目标
+  kGoalRoomMacro
+};
+
+// 宏推动: 把若干次推动合成搜索树上的一个节点, 中间局面不再展开.
+class MacroMoves {
+ public:
+  void generate(const Board& board, const DeadLock& dl);
+  // push 已经做在 board 上. 如果能接着做宏推动, 后续推动也做在 board 上并追加到 pushes,
+  // 返回宏的类型; 否则什么都不做, 返回 kNoMacro
+  MacroType extend(Board& board, const Push& push, std::vector<Push>& pushes) const;
+  // 还原一次宏推动的完整推动序列(含第一次推动), 追加到 pushes
+  void expand(int boxSolt, Direction dir, int destSolt, MacroType type, std::vector<Push>& pushes) const;
+  size_t goalRooms() const { return rooms_.size(); }
+
+ private:
+  // 只有一个入口的目标房间. 入口是一格宽的通道, 箱子只能沿 entryDir 推进房间
+  struct GoalRoom {
+    int entrance;
+    Direction entryDir;
+    // 按填充顺序排列的目标, paths[i] 是房间里已经填好 order[0..i) 时从入口把箱子推到 order[i] 的推动序列
+    std::vector<int> order;
+    std::vector<std::vector<Push>> paths;
+  };
+
+  bool isTunnel(const Board& board, int solt, Direction dir) const;
+  bool isCorridor(const Board& board, int solt) const;
+  int filledGoals(const Board& board, int room) const;
+  bool packRoom(const Board& board, int room, GoalRoom& goalRoom) const;
+  bool pullOut(const Board& board, int room, const GoalRoom& goalRoom, int goal,
+      const std::vector<char>& filled, std::vector<Push>& path) const;
+
+  const DeadLock* dl_ = nullptr;
+  int file_ = 0;
+  std::vector<GoalRoom> rooms_;
+  // 每格所属的目标房间下标, -1 表示不在房间里
+  std::vector<int> roomOf_;
+};
+
+#endif // #ifndef WSUN_SOKOBAN_MACRO_H_
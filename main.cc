@@ -1,16 +1,202 @@
 #include "parser.h"
 #include "solver.h"
+#include "batch.h"
+#include "parallel.h"
+#include "ida.h"
+#include "bidirectional.h"
+#include "external.h"
+#include "levelpack.h"
+#include "solutioncache.h"
 #include "zobrist.h"
+#include <unistd.h>
+#include <cstring>
+
+static void usage(const char* name) {
+  printf("usage: %s [-t transposition_mb] [-e manhattan|matching] [-T seconds] [-M mb]\n"
+         "          [-b all|first[-last] | -p | -i | -d | -x scratch_dir] [-D disk_mb]\n"
+         "          [-j threads] [-P pattern_file] [-I progress_nodes] [-S profile_sample_rate]\n"
+         "          [-L level_pack | -X collection.xsb] [-C output_pack] [-c solution_cache] [level]\n", name);
+}
+
+// 从关卡包里只解码 [first, last] 范围的关卡(从1开始编号), 其余位置留空
+static bool loadLevelPack(const char* path, int first, int last, LevelArray& levels) {
+  LevelPack pack;
+  if (!pack.open(path)) return false;
+  last = std::min(last, static_cast<int>(pack.size()));
+  levels.resize(std::max(last, 0));
+  for (int i = std::max(first, 1); i <= last; ++i) {
+    if (!pack.level(i - 1, levels[i - 1])) fprintf(stderr, "level %d in %s is damaged\n", i, path);
+  }
+  return true;
+}
+
+// 流式读关卡集文件, 读到第 last 个就停, 只留下 [first, last] 范围的关卡
+static bool loadCollection(const char* path, int first, int last, LevelArray& levels) {
+  std::ifstream in(path);
+  if (!in) return false;
+  CollectionReader reader(in);
+  Level level;
+  for (int i = 1; i <= last && reader.next(level); ++i) {
+    levels.emplace_back();
+    if (i >= first) levels.back() = std::move(level);
+  }
+  return true;
+}
 
 int main(int argc, char** argv) {
+  SearchOptions options;
+  bool batch = false;
+  bool parallel = false;
+  bool iterative = false;
+  bool bidirectional = false;
+  bool external = false;
+  int first = 0;
+  int last = 0;
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  const char* patternPath = nullptr;
+  const char* packPath = nullptr;
+  const char* convertPath = nullptr;
+  const char* collectionPath = nullptr;
+  const char* cachePath = nullptr;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:e:T:M:b:pidx:D:j:P:I:S:L:C:X:c:")) != -1) {
+    switch (opt) {
+      case 't':
+        options.transpositionBytes = static_cast<size_t>(atoi(optarg)) << 20;
+        break;
+      case 'e':
+        if (strcmp(optarg, "manhattan") == 0) {
+          options.heuristic = HeuristicType::kManhattan;
+        } else if (strcmp(optarg, "matching") == 0) {
+          options.heuristic = HeuristicType::kMatching;
+        } else {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'T':
+        options.timeLimitMs = static_cast<uint64_t>(atoi(optarg)) * 1000;
+        break;
+      case 'M':
+        options.memoryLimitBytes = static_cast<size_t>(atoi(optarg)) << 20;
+        break;
+      case 'b':
+        batch = true;
+        if (!parseRange(optarg, first, last)) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'p':
+        parallel = true;
+        break;
+      case 'i':
+        iterative = true;
+        break;
+      case 'd':
+        bidirectional = true;
+        break;
+      case 'x':
+        external = true;
+        options.scratchDir = optarg;
+        break;
+      case 'D':
+        options.diskLimitBytes = static_cast<size_t>(atoi(optarg)) << 20;
+        break;
+      case 'j':
+        threads = std::max(1, atoi(optarg));
+        break;
+      case 'P':
+        patternPath = optarg;
+        break;
+      case 'I':
+        options.progressInterval = strtoull(optarg, nullptr, 10);
+        break;
+      case 'S':
+        options.profileSampleRate = std::max(1ull, strtoull(optarg, nullptr, 10));
+        break;
+      case 'L':
+        packPath = optarg;
+        break;
+      case 'C':
+        convertPath = optarg;
+        break;
+      case 'X':
+        collectionPath = optarg;
+        break;
+      case 'c':
+        cachePath = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  // 模式库文件不存在时从空库开始, 结束时写回
+  PatternDatabase patterns;
+  if (patternPath != nullptr) {
+    patterns.load(patternPath);
+    options.patterns = &patterns;
+  }
+  // 解答缓存同样: 文件不存在时从空缓存开始, 结束时写回
+  SolutionCache cache;
+  if (cachePath != nullptr) cache.load(cachePath);
+
+  if (convertPath != nullptr) {
+    LevelArray levels;
+    if (collectionPath == nullptr) {
+      getAllLevels(levels);
+    } else if (!loadCollection(collectionPath, 1, INT_MAX, levels)) {
+      fprintf(stderr, "failed to open collection %s\n", collectionPath);
+      return 1;
+    }
+    if (!writeLevelPack(levels, convertPath)) {
+      fprintf(stderr, "failed to write level pack %s\n", convertPath);
+      return 1;
+    }
+    printf("packed %zu levels into %s\n", levels.size(), convertPath);
+    return 0;
+  }
 
+  int levelIdx = 0;
+  if (!batch && optind < argc) {
+    levelIdx = atoi(argv[optind]) - 1;
+  }
+  int loadFirst = batch ? first : levelIdx + 1;
+  int loadLast = batch ? last : levelIdx + 1;
   LevelArray levels;
-  getAllLevels(levels);
+  if (packPath != nullptr) {
+    if (!loadLevelPack(packPath, loadFirst, loadLast, levels)) {
+      fprintf(stderr, "failed to open level pack %s\n", packPath);
+      return 1;
+    }
+  } else if (collectionPath != nullptr) {
+    if (!loadCollection(collectionPath, loadFirst, loadLast, levels)) {
+      fprintf(stderr, "failed to open collection %s\n", collectionPath);
+      return 1;
+    }
+  } else {
+    getAllLevels(levels);
+  }
   // for (auto level : levels) printLevel(level);
-  int levelIdx = 0;
-
-  if (argc > 1) {
-    levelIdx = atoi(argv[1]) - 1;
+  if (batch) {
+    solveBatch(levels, first, last, threads, options, stdout, cachePath != nullptr ? &cache : nullptr);
+    if (patternPath != nullptr && !patterns.save(patternPath)) {
+      fprintf(stderr, "failed to save patterns to %s\n", patternPath);
+    }
+    if (cachePath != nullptr && !cache.save(cachePath)) {
+      fprintf(stderr, "failed to save solution cache to %s\n", cachePath);
+    }
+    return 0;
+  }
+  if (levelIdx < 0 || levelIdx >= static_cast<int>(levels.size())) {
+    fprintf(stderr, "no level %d\n", levelIdx + 1);
+    return 1;
+  }
+  if (const char* error = levelError(levels[levelIdx])) {
+    fprintf(stderr, "level %d: %s\n", levelIdx + 1, error);
+    return 1;
   }
   Board board(levels[levelIdx]);
   // std::vector<Push> pushes;
@@ -27,7 +213,31 @@ int main(int argc, char** argv) {
   //   std::cout << "---" << std::endl;
   //   board.print();
   // }
-  astarSearch(board);
+  SearchResult result;
+  const Board start(board);
+  if (cachePath != nullptr && cache.lookup(board, result)) {
+    printf("solution cache hit, verified by replay\n");
+  } else if (parallel) {
+    result = parallelAstarSearch(board, threads, options);
+  } else if (iterative) {
+    result = idaSearch(board, options);
+  } else if (bidirectional) {
+    result = bidirectionalSearch(board, options);
+  } else if (external) {
+    result = externalSearch(board, options);
+  } else {
+    result = astarSearch(board, options);
+  }
+  if (result.solved()) {
+    printf("pushes: %zu, moves: %zu\n%s\n", result.pushes.size(), result.moves.size(), result.moves.c_str());
+  }
+  if (patternPath != nullptr && !patterns.save(patternPath)) {
+    fprintf(stderr, "failed to save patterns to %s\n", patternPath);
+  }
+  if (cachePath != nullptr && !result.cached) {
+    cache.store(start, result);
+    if (!cache.save(cachePath)) fprintf(stderr, "failed to save solution cache to %s\n", cachePath);
+  }
 
 
   return 0;
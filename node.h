@@ -0,0 +1,61 @@
+#ifndef WSUN_SOKOBAN_NODE_H
+#define WSUN_SOKOBAN_NODE_H
+
+#include <inttypes.h>
+#include <memory>
+#include <vector>
+
+static const uint32_t kNoParent = UINT32_MAX;
+
+// 搜索树节点, 只记录父节点和到达它的那一步推箱子(或一次宏推动).
+// 局面本身不保存, 需要时从当前局面沿父链 undo/redo 过去.
+struct SearchNode {
+  uint32_t parent;
+  uint16_t boxSolt;  // 推之前箱子所在的格子
+  int16_t dir;       // 同 Push::dir, 格子偏移量. 宏推动时是第一次推动的方向
+  uint16_t depth;    // 节点在树上的深度
+  uint16_t g;        // 推箱子步数, 宏推动算多步
+  uint16_t h;
+  uint16_t destSolt; // 推完之后箱子所在的格子
+  uint8_t macro;     // MacroType
+};
+
+// 分块分配的节点池, 扩容不搬移已有节点, 节点之间只用下标引用
+class NodeArena {
+ public:
+  static const int kChunkBits = 16;
+  static const uint32_t kChunkSize = 1u << kChunkBits;
+
+  NodeArena() : size_(0) {}
+
+  uint32_t add(const SearchNode& node) {
+    if ((size_ & (kChunkSize - 1)) == 0 && (size_ >> kChunkBits) == chunks_.size()) {
+      chunks_.emplace_back(new SearchNode[kChunkSize]);
+    }
+    uint32_t idx = size_++;
+    (*this)[idx] = node;
+    return idx;
+  }
+
+  SearchNode& operator[](uint32_t idx) {
+    return chunks_[idx >> kChunkBits][idx & (kChunkSize - 1)];
+  }
+
+  const SearchNode& operator[](uint32_t idx) const {
+    return chunks_[idx >> kChunkBits][idx & (kChunkSize - 1)];
+  }
+
+  uint32_t size() const { return size_; }
+  size_t memoryBytes() const { return chunks_.size() * kChunkSize * sizeof(SearchNode); }
+
+  void clear() {
+    chunks_.clear();
+    size_ = 0;
+  }
+
+ private:
+  std::vector<std::unique_ptr<SearchNode[]>> chunks_;
+  uint32_t size_;
+};
+
+#endif
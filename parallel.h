@@ -0,0 +1,370 @@
+#ifndef WSUN_SOKOBAN_PARALLEL_H
+#define WSUN_SOKOBAN_PARALLEL_H
+
+#include "solver.h"
+#include "spscqueue.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+// 按哈希分区的并行 A* (HDA*).
+// 每个局面按箱子部分的 Zobrist 归属唯一一个工作线程, 线程各自维护开放表和置换表,
+// 生成的子节点通过无锁队列发给所属线程.
+// 各线程公布自己开放表队首的优先级(f, 再是更深的 g), 只展开不比全局最好的差的节点.
+// 否则同一层 f 里单线程本可以一路往深处走到解, 多线程时空闲的线程会去展开大量较浅的节点.
+// 找到解之后丢掉 f 不小于当前解的节点, 所有线程的开放表都空了(最小 f 都不小于当前解)
+// 并且没有在途消息时停止.
+namespace hda {
+
+struct StateMessage {
+  DynamicData data;
+  uint16_t g;
+  uint16_t h;
+  uint16_t parentWorker;
+  uint32_t parentRecord;
+  uint16_t boxSolt;
+  int16_t dir;
+  // 同 SearchNode, 宏推动结束时箱子的位置和宏的类型
+  uint16_t destSolt;
+  uint8_t macro;
+};
+
+struct OpenEntry {
+  uint16_t f;
+  uint16_t g;
+  uint32_t record;
+
+  // f 小的优先, f 相同时 g 大(更深)的优先
+  bool operator<(const OpenEntry& rhs) const {
+    return f == rhs.f ? g < rhs.g : f > rhs.f;
+  }
+
+  // 同样的顺序压成一个整数, 越小越优先
+  int priority() const {
+    return (static_cast<int>(f) << 16) | (0xffff - g);
+  }
+};
+
+struct Worker {
+  std::vector<StateMessage> records;
+  std::priority_queue<OpenEntry> open;
+  // 公布给其他线程的开放表队首优先级, 正在展开的节点也算在内; 开放表为空时是 INT_MAX
+  std::atomic<int> best{INT_MAX};
+  uint64_t generateNodes = 0;
+  uint64_t explorNodes = 0;
+  uint64_t deadlockNodes = 0;
+  uint64_t frozenNodes = 0;
+  uint64_t patternNodes = 0;
+  uint64_t corralNodes = 0;
+  PatternDatabase patterns;
+  size_t memoryBytes = 0;
+};
+
+struct Shared {
+  int threads;
+  // queues[to * threads + from]
+  std::vector<std::unique_ptr<SpscQueue<StateMessage>>> queues;
+  std::vector<Worker> workers;
+  std::atomic<uint64_t> sent{0};
+  std::atomic<uint64_t> received{0};
+  std::atomic<int> idle{0};
+  std::atomic<bool> done{false};
+  std::atomic<int> incumbent{INT_MAX};
+  std::mutex mutex;
+  SearchStatus stopStatus = SearchStatus::kNoSolution;
+  int solutionWorker = -1;
+  uint32_t solutionRecord = kNoParent;
+  uint64_t startTime = 0;
+
+  SpscQueue<StateMessage>& queue(int to, int from) {
+    return *queues[to * threads + from];
+  }
+
+  // 发消息前先把接收方公布的优先级压低, 在途的节点也参与比较
+  void lowerBest(int to, int priority) {
+    std::atomic<int>& best = workers[to].best;
+    int current = best.load();
+    while (priority < current && !best.compare_exchange_weak(current, priority)) {}
+  }
+
+  int globalBest() const {
+    int best = INT_MAX;
+    for (const auto& worker : workers) best = std::min(best, worker.best.load());
+    return best;
+  }
+
+  void stop(SearchStatus status) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!done) stopStatus = status;
+    done = true;
+  }
+};
+
+static int ownerOf(const Board& board, int threads) {
+  Zobrist key(board.zobrist);
+  key.XOR(board.context->playerKey(board.playerSolt));
+  uint64_t h = key.Hash();
+  return static_cast<int>((h ^ (h >> 29)) % threads);
+}
+
+static void addOpen(Worker& worker, const StateMessage& msg) {
+  worker.open.push(OpenEntry{ static_cast<uint16_t>(msg.g + msg.h), msg.g,
+      static_cast<uint32_t>(worker.records.size()) });
+  worker.records.push_back(msg);
+}
+
+static void runWorker(Shared& shared, int id, const Board& start, const DeadLock& dl,
+    const MacroMoves& macros, const SearchOptions& options) {
+  Worker& self = shared.workers[id];
+  Board board(start);
+  Heuristic heuristic(options.heuristic, dl, board);
+  heuristic.reset(board);
+  board.heuristic = &heuristic;
+  CorralPruner corrals(dl, board);
+  TranspositionTable closed(options.transpositionBytes / shared.threads, positionBound(board, dl));
+  size_t memoryLimit = options.memoryLimitBytes / shared.threads;
+  // 置换表按需扩容, 搜索中定期取样, 退出时再取一次
+  auto sampleMemory = [&] {
+    self.memoryBytes = std::max(self.memoryBytes, closed.memoryBytes() +
+        self.records.capacity() * sizeof(StateMessage) + self.open.size() * sizeof(OpenEntry));
+  };
+
+  bool isIdle = false;
+  std::vector<Push> pushes;
+  std::vector<Push> macroPushes;
+  StateMessage msg;
+  while (!shared.done) {
+    for (int from = 0; from < shared.threads; ++from) {
+      SpscQueue<StateMessage>& q = shared.queue(id, from);
+      while (q.pop(msg)) {
+        // 先退出空闲再计数, 终止检测依赖这个顺序
+        if (isIdle) {
+          --shared.idle;
+          isIdle = false;
+        }
+        ++shared.received;
+        if (msg.g + msg.h < shared.incumbent) addOpen(self, msg);
+      }
+    }
+
+    if (!self.open.empty() && self.open.top().f >= shared.incumbent) {
+      self.open = std::priority_queue<OpenEntry>();
+    }
+    self.best = self.open.empty() ? INT_MAX : self.open.top().priority();
+    if (self.open.empty()) {
+      if (!isIdle) {
+        isIdle = true;
+        ++shared.idle;
+      }
+      uint64_t received = shared.received;
+      int idle = shared.idle;
+      uint64_t sent = shared.sent;
+      if (idle == shared.threads && received == sent) {
+        shared.stop(SearchStatus::kNoSolution);
+      } else {
+        std::this_thread::yield();
+      }
+      continue;
+    }
+    // 别的线程有更优先的节点, 先等它们展开. 持有全局最优先节点的线程总能继续, 不会互相等死
+    if (self.open.top().priority() > shared.globalBest()) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    OpenEntry entry = self.open.top();
+    self.open.pop();
+    const StateMessage& record = self.records[entry.record];
+    board.recoverFromData(record.data);
+    ++self.explorNodes;
+
+    if ((self.explorNodes & 1023) == 0) {
+      sampleMemory();
+      if (memoryLimit != 0 && self.memoryBytes > memoryLimit) {
+        shared.stop(SearchStatus::kMemoryLimit);
+        break;
+      }
+      if (options.timeLimitMs != 0 && (getNowTime() - shared.startTime) / 1000000 > options.timeLimitMs) {
+        shared.stop(SearchStatus::kTimeLimit);
+        break;
+      }
+    }
+
+    Reach reach;
+    calcReachableTiles(board, reach);
+    if (!closed.insert(board.normalizedZobrist(reach.minReachableSolt), entry.g)) {
+      continue;
+    }
+
+    if (checkGameOver(board)) {
+      std::lock_guard<std::mutex> lock(shared.mutex);
+      if (entry.g < shared.incumbent) {
+        shared.incumbent = entry.g;
+        shared.solutionWorker = id;
+        shared.solutionRecord = entry.record;
+      }
+      continue;
+    }
+
+    pushes.clear();
+    getPushes(board, reach, pushes);
+    if (corrals.prune(board, reach, pushes)) ++self.corralNodes;
+    uint16_t g = entry.g + 1;
+    bool expanded = false;
+    for (const auto& p : pushes) {
+      ++self.generateNodes;
+      if (dl.isDeadSolt(p.boxSolt + p.dir)) continue;
+      doPush(board, p);
+      macroPushes.clear();
+      MacroType macro = macros.extend(board, p, macroPushes);
+      int dest = macroPushes.empty() ? p.boxSolt + p.dir : macroPushes.back().boxSolt + macroPushes.back().dir;
+      if (dl.isFreezeDeadlock(board, dest)) {
+        ++self.frozenNodes;
+        undoPushes(board, macroPushes);
+        undoPush(board, p);
+        continue;
+      }
+      if (self.patterns.isDeadlock(board, dest)) {
+        ++self.patternNodes;
+        undoPushes(board, macroPushes);
+        undoPush(board, p);
+        continue;
+      }
+      int h = heuristic.value();
+      if (h == Heuristic::kDeadlock) {
+        ++self.deadlockNodes;
+        undoPushes(board, macroPushes);
+        undoPush(board, p);
+        continue;
+      }
+      expanded = true;
+      uint16_t childG = g + macroPushes.size();
+      if (childG + h >= shared.incumbent) {
+        undoPushes(board, macroPushes);
+        undoPush(board, p);
+        continue;
+      }
+      StateMessage child;
+      board.extractDynamicData(child.data);
+      child.g = childG;
+      child.h = static_cast<uint16_t>(h);
+      child.parentWorker = static_cast<uint16_t>(id);
+      child.parentRecord = entry.record;
+      child.boxSolt = static_cast<uint16_t>(p.boxSolt);
+      child.dir = static_cast<int16_t>(p.dir);
+      child.destSolt = static_cast<uint16_t>(dest);
+      child.macro = macro;
+      int owner = ownerOf(board, shared.threads);
+      undoPushes(board, macroPushes);
+      undoPush(board, p);
+      if (owner == id) {
+        addOpen(self, child);
+      } else {
+        ++shared.sent;
+        shared.lowerBest(owner, (static_cast<int>(child.g + child.h) << 16) | (0xffff - child.g));
+        shared.queue(owner, id).push(child);
+      }
+    }
+    // 所有推法都被死锁检测剪掉, 从最后推动的箱子周围学习死锁模式.
+    // addOpen 可能让 records 扩容, 这里重新取记录
+    const StateMessage& parent = self.records[entry.record];
+    if (!expanded && parent.parentRecord != kNoParent) {
+      self.patterns.learn(board, parent.destSolt);
+    }
+  }
+  sampleMemory();
+  board.heuristic = nullptr;
+}
+
+} // namespace hda
+
+static SearchResult parallelAstarSearch(Board& board, int threads,
+    const SearchOptions& options = SearchOptions()) {
+  SearchResult result;
+  hda::Shared shared;
+  shared.startTime = getNowTime();
+  shared.threads = std::max(1, threads);
+  DeadLock dl;
+  dl.generate(board);
+  MacroMoves macros;
+  macros.generate(board, dl);
+
+  for (int i = 0; i < shared.threads * shared.threads; ++i) {
+    shared.queues.emplace_back(new SpscQueue<hda::StateMessage>);
+  }
+  // Worker 里的模式库不能移动, 只能一次构造好
+  shared.workers = std::vector<hda::Worker>(shared.threads);
+  if (options.patterns != nullptr) {
+    for (auto& worker : shared.workers) worker.patterns.copyFrom(*options.patterns);
+  }
+
+  Heuristic heuristic(options.heuristic, dl, board);
+  heuristic.reset(board);
+  if (heuristic.value() == Heuristic::kDeadlock) return result;
+  hda::StateMessage root;
+  board.extractDynamicData(root.data);
+  root.g = 0;
+  root.h = static_cast<uint16_t>(heuristic.value());
+  root.parentWorker = 0;
+  root.parentRecord = kNoParent;
+  root.boxSolt = 0;
+  root.dir = 0;
+  root.destSolt = 0;
+  root.macro = kNoMacro;
+  hda::addOpen(shared.workers[hda::ownerOf(board, shared.threads)], root);
+
+  std::vector<std::thread> threadPool;
+  for (int i = 0; i < shared.threads; ++i) {
+    threadPool.emplace_back(hda::runWorker, std::ref(shared), i, std::cref(board),
+        std::cref(dl), std::cref(macros), std::cref(options));
+  }
+  for (auto& t : threadPool) t.join();
+
+  for (const auto& worker : shared.workers) {
+    result.generateNodes += worker.generateNodes;
+    result.explorNodes += worker.explorNodes;
+    result.deadlockNodes += worker.deadlockNodes;
+    result.frozenNodes += worker.frozenNodes;
+    result.patternNodes += worker.patternNodes;
+    result.corralNodes += worker.corralNodes;
+    if (options.patterns != nullptr) options.patterns->merge(worker.patterns);
+    result.peakMemoryBytes += worker.memoryBytes;
+  }
+  result.status = shared.stopStatus;
+  // 因为时间/内存限制提前停止时, 返回的是已经找到的最好的解
+  if (shared.solutionWorker >= 0) {
+    result.status = SearchStatus::kSolved;
+    int worker = shared.solutionWorker;
+    uint32_t record = shared.solutionRecord;
+    std::vector<const hda::StateMessage*> chain;
+    while (true) {
+      const hda::StateMessage& msg = shared.workers[worker].records[record];
+      if (msg.parentRecord == kNoParent) break;
+      chain.push_back(&msg);
+      worker = msg.parentWorker;
+      record = msg.parentRecord;
+    }
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+      const hda::StateMessage& msg = **it;
+      if (msg.macro == kNoMacro) {
+        result.pushes.emplace_back(msg.boxSolt, msg.dir, msg.boxSolt - msg.dir);
+      } else {
+        macros.expand(msg.boxSolt, msg.dir, msg.destSolt, static_cast<MacroType>(msg.macro), result.pushes);
+      }
+    }
+    expandToMoves(board, result.pushes, result.moves);
+  }
+  result.timeMs = (getNowTime() - shared.startTime) / 1000000;
+  if (options.verbose) {
+    printf("%s in parallel Astar search with %d threads\n", statusName(result.status), shared.threads);
+    printf("explorNodes per thread:");
+    for (const auto& worker : shared.workers) printf(" %lu", worker.explorNodes);
+    printf("\n");
+    printf("generateNodes: %lu, explorNodes: %lu, deadlockNodes: %lu, frozenNodes: %lu, patternNodes: %lu, corralNodes: %lu, spent time: %lu ms\n",
+        result.generateNodes, result.explorNodes, result.deadlockNodes, result.frozenNodes, result.patternNodes,
+        result.corralNodes, result.timeMs);
+  }
+  return result;
+}
+
+#endif
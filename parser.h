@@ -7,7 +7,10 @@
 #include <dirent.h>
 #include <set>
 #include <string>
+#include <vector>
 #include "config.h"
+#include "bitboard.h"
+#include "boxset.h"
 
 
 static SquareType& operator |=(SquareType& left, SquareType right) {
@@ -67,7 +70,8 @@ static void getMap(const std::string& levelStr, Level& level) {
     }
     else {
       int idx = i * level.file + j;
-      SquareType type = kSymbolsMap.find(c)->second;
+      auto it = kSymbolsMap.find(c);
+      SquareType type = it == kSymbolsMap.end() ? SquareType::kFloor : it->second;
       if (type & SquareType::kWall) level.map[idx] |= SquareType::kWall;
       if (type & SquareType::kBox) level.map[idx] |= SquareType::kBox;
       if (type & SquareType::kGoal) level.map[idx] |= SquareType::kGoal;
@@ -89,6 +93,219 @@ static void getAllLevels(LevelArray& levels) {
   }
 }
 
+// 从玩家出发(不计箱子)填充出关卡内部, 走不到的格子标成 kEmpty.
+// 内部格子不能在地图边上, 碰到边上(或墙外)的格子就把它当墙补上, 这样内部格子的邻格
+// 总在地图里, 内层循环不用判断越界. 四周有墙的正常关卡不会被改动
+static void sealInterior(Map& map, int file, int playerSolt) {
+  int rank = static_cast<int>(map.size()) / file;
+  std::vector<char> inside(map.size(), 0);
+  std::vector<int> stack(1, playerSolt);
+  inside[playerSolt] = 1;
+  const int dirs[4] = { -1, 1, -file, file };
+  while (!stack.empty()) {
+    int solt = stack.back();
+    stack.pop_back();
+    for (int dir : dirs) {
+      int next = solt + dir;
+      if (inside[next] || (map[next] & SquareType::kWall)) continue;
+      int row = next / file;
+      int col = next % file;
+      if (row == 0 || row == rank - 1 || col == 0 || col == file - 1 || (map[next] & SquareType::kEmpty)) {
+        map[next] = SquareType::kWall;
+        continue;
+      }
+      inside[next] = 1;
+      stack.push_back(next);
+    }
+  }
+  for (size_t i = 0; i < map.size(); ++i) {
+    if (!inside[i] && !(map[i] & SquareType::kWall)) map[i] = SquareType::kEmpty;
+  }
+}
+
+// 求解器处理不了的关卡返回原因, 能处理返回 nullptr. 位图内核按字平移, 一行要放得进一个字;
+// 位图和箱子集合都是定长的. 箱子和目标按 sealInterior 之后的图数, 墙外的不算
+static const char* levelError(const Level& level) {
+  if (level.file >= 64) return "wider than 63 squares";
+  if (level.rank * level.file > Bitboard::kMaxSquares) return "more than 2048 squares";
+  int players = 0;
+  int player = 0;
+  for (size_t i = 0; i < level.map.size(); ++i) {
+    if (level.map[i] & SquareType::kPlayer) {
+      ++players;
+      player = i;
+    }
+  }
+  if (players != 1) return players == 0 ? "no player" : "more than one player";
+  int row = player / level.file;
+  int col = player % level.file;
+  if (row == 0 || col == 0 || row == level.rank - 1 || col == level.file - 1) return "player on the border";
+
+  Map map = level.map;
+  sealInterior(map, level.file, player);
+  int boxes = 0;
+  int goals = 0;
+  for (SquareType st : map) {
+    if (st & SquareType::kBox) ++boxes;
+    if (st & SquareType::kGoal) ++goals;
+  }
+  if (boxes == 0) return "no boxes";
+  if (boxes > kMaxBoxes) return "more than 64 boxes";
+  if (goals > kMaxBoxes) return "more than 64 goals";
+  if (boxes != goals) return "box and goal counts differ";
+  return nullptr;
+}
+
+// 流式读取 XSB/SOK 格式的关卡集, 一次读一行, 凑齐一个关卡就交出去, 不缓存整个文件.
+// 支持行程编码的行("4#-@2$|#.#", '|' 分行), '-'/'_' 表示空地, SOK 的 p/P/b/B,
+// 以 ';' 开头的注释, "Title:" 行和关卡之间的其他文字; 墙外面的格子标成 kEmpty.
+// 求解器处理不了的关卡(见 levelError)在 stderr 上报告后跳过, 由后面的关卡顶上
+class CollectionReader {
+ public:
+  explicit CollectionReader(std::istream& in) : in_(in) {}
+
+  // 读出下一个关卡, 没有了返回 false
+  bool next(Level& level) {
+    while (read(level)) {
+      ++count_;
+      const char* error = levelError(level);
+      if (error == nullptr) return true;
+      std::cerr << "skip level " << count_ << (level.title.empty() ? "" : " (" + level.title + ")")
+          << ": " << error << std::endl;
+    }
+    return false;
+  }
+
+ private:
+  bool read(Level& level) {
+    std::vector<std::string> rows;
+    std::string title;
+    std::string line;
+    while (readLine(line)) {
+      if (decodeRow(line, rows)) continue;
+      if (!rows.empty()) {
+        // SOK 把标题写在关卡后面, 其他文字留给下一个关卡
+        if (!titleOf(line, title)) {
+          pending_ = line;
+          hasPending_ = true;
+        }
+        break;
+      }
+      std::string text;
+      if (titleOf(line, text) || commentOf(line, text)) title = text;
+    }
+    if (rows.empty()) return false;
+    build(rows, level);
+    level.title = title;
+    return true;
+  }
+
+  bool readLine(std::string& line) {
+    if (hasPending_) {
+      line.swap(pending_);
+      hasPending_ = false;
+      return true;
+    }
+    return static_cast<bool>(std::getline(in_, line));
+  }
+
+  static std::string trim(const std::string& str) {
+    size_t begin = str.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) return std::string();
+    size_t end = str.find_last_not_of(" \t\r");
+    return str.substr(begin, end - begin + 1);
+  }
+
+  static bool titleOf(const std::string& line, std::string& title) {
+    std::string text = trim(line);
+    if (text.compare(0, 6, "Title:") != 0) return false;
+    title = trim(text.substr(6));
+    return true;
+  }
+
+  // 注释和关卡之间的文字行, 最后一条当作后面关卡的标题
+  static bool commentOf(const std::string& line, std::string& comment) {
+    std::string text = trim(line);
+    if (!text.empty() && text[0] == ';') text = trim(text.substr(1));
+    if (text.empty() || text.find(':') != std::string::npos) return false;
+    comment = text;
+    return true;
+  }
+
+  // 把一行解码成一到多行棋盘追加到 rows. 含有棋盘以外的字符或者没有墙时不是棋盘行
+  static bool decodeRow(const std::string& line, std::vector<std::string>& rows) {
+    size_t end = line.find_last_not_of(" \t\r");
+    if (end == std::string::npos) return false;
+    std::vector<std::string> decoded(1);
+    bool wall = false;
+    int count = 0;
+    for (size_t i = 0; i <= end; ++i) {
+      char c = line[i];
+      if (c >= '0' && c <= '9') {
+        count = count * 10 + (c - '0');
+        continue;
+      }
+      switch (c) {
+        case '-': case '_': c = ' '; break;
+        case 'p': c = '@'; break;
+        case 'P': c = '+'; break;
+        case 'b': c = '$'; break;
+        case 'B': c = '*'; break;
+        case '|':
+          decoded.emplace_back();
+          count = 0;
+          continue;
+        case '#': wall = true; break;
+        case ' ': case '@': case '+': case '$': case '*': case '.': break;
+        default: return false;
+      }
+      decoded.back().append(std::max(count, 1), c);
+      count = 0;
+    }
+    if (!wall) return false;
+    rows.insert(rows.end(), decoded.begin(), decoded.end());
+    return true;
+  }
+
+  // 从四周边上不是墙的格子往里扩散, 走得到的都在墙外面
+  static void build(const std::vector<std::string>& rows, Level& level) {
+    level.rank = rows.size();
+    level.file = 0;
+    for (const auto& row : rows) level.file = std::max(level.file, static_cast<int>(row.size()));
+    level.map.assign(level.rank * level.file, SquareType::kFloor);
+    for (int i = 0; i < level.rank; ++i) {
+      for (size_t j = 0; j < rows[i].size(); ++j) {
+        level.map[i * level.file + j] = kSymbolsMap.find(rows[i][j])->second;
+      }
+    }
+
+    std::vector<int> stack;
+    for (int i = 0; i < level.rank; ++i) {
+      for (int j = 0; j < level.file; ++j) {
+        if (i == 0 || j == 0 || i == level.rank - 1 || j == level.file - 1) stack.push_back(i * level.file + j);
+      }
+    }
+    while (!stack.empty()) {
+      int idx = stack.back();
+      stack.pop_back();
+      if (level.map[idx] != SquareType::kFloor) continue;
+      level.map[idx] = SquareType::kEmpty;
+      int i = idx / level.file;
+      int j = idx % level.file;
+      if (i > 0) stack.push_back(idx - level.file);
+      if (i < level.rank - 1) stack.push_back(idx + level.file);
+      if (j > 0) stack.push_back(idx - 1);
+      if (j < level.file - 1) stack.push_back(idx + 1);
+    }
+  }
+
+  std::istream& in_;
+  std::string pending_;
+  bool hasPending_ = false;
+  // 文件里已经读过的关卡数, 包括跳过的
+  int count_ = 0;
+};
+
 static void printLevel(const Level& level) {
   int j = 0;
   for (SquareType st : level.map) {
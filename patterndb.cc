@@ -0,0 +1,218 @@
+#include "patterndb.h"
+#include "solver.h"
+#include <cstdio>
+#include <fstream>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+// 玩家在窗口外(窗口外都是空地, 彼此连通)
+const int kOutside = PatternDatabase::kWindowSquares;
+const uint32_t kFileMagic = 0x42445053; // "SPDB"
+const uint32_t kFileVersion = 1;
+// 键不超过 5^25 * 26 < 2^63, 存文件时最高位记录是否死锁
+const uint64_t kDeadlockBit = 1ull << 63;
+
+// 窗口内 cell 沿方向 d(左右上下) 的邻格, 出了窗口返回 -1
+int neighbor(int cell, int d) {
+  static const int kOffsets[4][2] = { { 0, -1 }, { 0, 1 }, { -1, 0 }, { 1, 0 } };
+  int r = cell / PatternDatabase::kWindowSize + kOffsets[d][0];
+  int c = cell % PatternDatabase::kWindowSize + kOffsets[d][1];
+  if (r < 0 || r >= PatternDatabase::kWindowSize || c < 0 || c >= PatternDatabase::kWindowSize) return -1;
+  return r * PatternDatabase::kWindowSize + c;
+}
+
+int opposite(int d) {
+  return d ^ 1;
+}
+
+// 窗口的25格按位存放, 整行整列的掩码用来做位并行的扩散
+const uint32_t kAllSquares = (1u << PatternDatabase::kWindowSquares) - 1;
+const uint32_t kLeftColumn = 0x0108421;
+const uint32_t kRightColumn = kLeftColumn << (PatternDatabase::kWindowSize - 1);
+const uint32_t kBorder = kLeftColumn | kRightColumn | 0x1f | (0x1fu << 20);
+
+// 从 start 出发能走到的窗口格子, outside 返回能否走出窗口.
+// 每轮把区域向四个方向各扩一格再和空地相与, 直到不再变化
+uint32_t floodRegion(uint32_t blocked, int start, bool& outside) {
+  uint32_t free = ~blocked & kAllSquares;
+  uint32_t region = start == kOutside ? kBorder & free : 1u << start;
+  while (true) {
+    uint32_t grown = region | ((region << 1) & ~kLeftColumn) | ((region >> 1) & ~kRightColumn) |
+      (region << PatternDatabase::kWindowSize) | (region >> PatternDatabase::kWindowSize);
+    grown &= free;
+    if (grown == region) break;
+    region = grown;
+  }
+  outside = start == kOutside || (region & kBorder) != 0;
+  return region;
+}
+
+// 能走出窗口的区域都连在一起, 统一记为 kOutside, 否则取区域里最小的格子
+int regionCode(uint32_t region, bool outside) {
+  return outside || region == 0 ? kOutside : __builtin_ctz(region);
+}
+
+} // namespace
+
+struct PatternDatabase::Window {
+  uint32_t walls = 0;
+  uint32_t goals = 0;
+  uint32_t boxes = 0;
+  int player = kOutside;
+  uint64_t key = 0;
+};
+
+// 窗口外的地图边界和关卡外部都当作墙. 窗口里没有不在目标上的箱子时不可能是死锁, 返回 false
+bool PatternDatabase::encode(const Board& m, int boxSolt, Window& window) const {
+  int rank = static_cast<int>(m.map.size()) / m.file;
+  int boxRow = boxSolt / m.file;
+  int boxCol = boxSolt % m.file;
+  int playerCell = kOutside;
+  for (int cell = 0; cell < kWindowSquares; ++cell) {
+    int r = boxRow + cell / kWindowSize - kWindowSize / 2;
+    int c = boxCol + cell % kWindowSize - kWindowSize / 2;
+    if (r < 0 || r >= rank || c < 0 || c >= m.file) {
+      window.walls |= 1u << cell;
+      continue;
+    }
+    int solt = r * m.file + c;
+    SquareType st = m.map[solt];
+    if (st & (SquareType::kWall | SquareType::kEmpty)) {
+      window.walls |= 1u << cell;
+      continue;
+    }
+    if (st & SquareType::kGoal) window.goals |= 1u << cell;
+    if (st & SquareType::kBox) window.boxes |= 1u << cell;
+    if (solt == m.playerSolt) playerCell = cell;
+  }
+  if ((window.boxes & ~window.goals) == 0) return false;
+
+  bool outside = false;
+  uint32_t region = floodRegion(window.walls | window.boxes, playerCell, outside);
+  window.player = regionCode(region, outside);
+
+  // 每格5种状态(墙, 空地, 目标, 箱子, 目标上的箱子)按5进制编码, 再接上玩家区域
+  uint64_t key = 0;
+  for (int cell = kWindowSquares - 1; cell >= 0; --cell) {
+    uint64_t digit = window.walls >> cell & 1 ? 0 :
+      1 + (window.goals >> cell & 1) + (window.boxes >> cell & 1) * 2;
+    key = key * 5 + digit;
+  }
+  window.key = key * (kWindowSquares + 1) + window.player;
+  return true;
+}
+
+// 在松弛问题上宽度优先搜索, 所有箱子都在目标上或被推出窗口就算解开
+bool PatternDatabase::search(const Window& window) {
+  ++searches_;
+  std::unordered_set<uint32_t> visited;
+  std::vector<uint32_t> queue;
+  uint32_t startState = window.boxes | static_cast<uint32_t>(window.player) << kWindowSquares;
+  visited.insert(startState);
+  queue.push_back(startState);
+  for (size_t head = 0; head < queue.size(); ++head) {
+    if (head >= static_cast<size_t>(kSearchBudget)) return false;
+    uint32_t boxes = queue[head] & ((1u << kWindowSquares) - 1);
+    int player = queue[head] >> kWindowSquares;
+    if ((boxes & ~window.goals) == 0) return false;
+
+    bool outside = false;
+    uint32_t region = floodRegion(window.walls | boxes, player, outside);
+    for (int box = 0; box < kWindowSquares; ++box) {
+      if (!(boxes >> box & 1)) continue;
+      for (int d = 0; d < 4; ++d) {
+        int from = neighbor(box, opposite(d));
+        if (from == -1 ? !outside : !(region >> from & 1)) continue;
+        int to = neighbor(box, d);
+        uint32_t next = boxes & ~(1u << box);
+        if (to != -1) {
+          if ((window.walls | boxes) >> to & 1) continue;
+          next |= 1u << to;
+        }
+        bool nextOutside = false;
+        uint32_t nextRegion = floodRegion(window.walls | next, box, nextOutside);
+        uint32_t state = next |
+          static_cast<uint32_t>(regionCode(nextRegion, nextOutside)) << kWindowSquares;
+        if (visited.insert(state).second) queue.push_back(state);
+      }
+    }
+  }
+  return true;
+}
+
+bool PatternDatabase::isDeadlock(const Board& board, int boxSolt) const {
+  if (deadlocks_ == 0) return false;
+  Window window;
+  if (!encode(board, boxSolt, window)) return false;
+  auto it = patterns_.find(window.key);
+  return it != patterns_.end() && it->second;
+}
+
+bool PatternDatabase::learn(const Board& board, int boxSolt) {
+  Window window;
+  if (!encode(board, boxSolt, window)) return false;
+  auto it = patterns_.find(window.key);
+  if (it != patterns_.end()) return it->second;
+  bool deadlock = search(window);
+  patterns_.emplace(window.key, deadlock);
+  if (deadlock) ++deadlocks_;
+  return deadlock;
+}
+
+void PatternDatabase::copyFrom(const PatternDatabase& other) {
+  std::lock_guard<std::mutex> lock(other.mutex_);
+  patterns_ = other.patterns_;
+  deadlocks_ = other.deadlocks_;
+}
+
+void PatternDatabase::merge(const PatternDatabase& other) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& e : other.patterns_) {
+    if (patterns_.emplace(e.first, e.second).second && e.second) ++deadlocks_;
+  }
+  searches_ += other.searches_;
+}
+
+// 文件格式: magic, version, 条目数, 然后是每个条目的键(最高位为死锁标记), 都按本机字节序
+bool PatternDatabase::load(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return false;
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  uint64_t count = 0;
+  in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+  in.read(reinterpret_cast<char*>(&version), sizeof(version));
+  in.read(reinterpret_cast<char*>(&count), sizeof(count));
+  if (!in || magic != kFileMagic || version != kFileVersion) return false;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (uint64_t i = 0; i < count; ++i) {
+    uint64_t entry = 0;
+    if (!in.read(reinterpret_cast<char*>(&entry), sizeof(entry))) return false;
+    bool deadlock = (entry & kDeadlockBit) != 0;
+    if (patterns_.emplace(entry & ~kDeadlockBit, deadlock).second && deadlock) ++deadlocks_;
+  }
+  return true;
+}
+
+bool PatternDatabase::save(const std::string& path) const {
+  // 先写临时文件再改名, 中途被打断也不会留下损坏的库
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t count = patterns_.size();
+    out.write(reinterpret_cast<const char*>(&kFileMagic), sizeof(kFileMagic));
+    out.write(reinterpret_cast<const char*>(&kFileVersion), sizeof(kFileVersion));
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const auto& e : patterns_) {
+      uint64_t entry = e.first | (e.second ? kDeadlockBit : 0);
+      out.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+    }
+    if (!out) return false;
+  }
+  return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
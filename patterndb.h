@@ -0,0 +1,55 @@
+#ifndef WSUN_SOKOBAN_PATTERNDB_H_
+#define WSUN_SOKOBAN_PATTERNDB_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct Board;
+
+// 局部死锁模式库.
+// 模式是以刚推动的箱子为中心的 5x5 窗口: 窗口内的墙/箱子/目标, 加上玩家在窗口里的连通区域.
+// 窗口外一律当作空地, 箱子推出窗口就算解决, 这是原局面的松弛: 松弛问题无解则原局面必然无解,
+// 所以学到的模式与关卡无关, 可以存到文件里在不同关卡和不同次运行之间复用.
+class PatternDatabase {
+ public:
+  static const int kWindowSize = 5;
+  static const int kWindowSquares = kWindowSize * kWindowSize;
+  // 每次子搜索最多访问的松弛局面数, 超过就当作不是死锁
+  static const int kSearchBudget = 512;
+
+  PatternDatabase() = default;
+  PatternDatabase(const PatternDatabase&) = delete;
+  PatternDatabase& operator=(const PatternDatabase&) = delete;
+
+  // 推到 boxSolt 的箱子周围是否匹配已知的死锁模式, 玩家位置取 board.playerSolt
+  bool isDeadlock(const Board& board, int boxSolt) const;
+  // 局面已知无解时调用: 对 boxSolt 周围的窗口做一次有界的子搜索, 证明死锁就记下来.
+  // 同一个窗口只搜索一次, 返回窗口是否是死锁模式
+  bool learn(const Board& board, int boxSolt);
+
+  // 搜索线程只读写自己的一份, 开始时从共享库拷贝, 结束时合并回去
+  void copyFrom(const PatternDatabase& other);
+  void merge(const PatternDatabase& other);
+  bool load(const std::string& path);
+  bool save(const std::string& path) const;
+
+  size_t size() const { return deadlocks_; }
+  uint64_t searches() const { return searches_; }
+
+ private:
+  struct Window;
+
+  bool encode(const Board& board, int boxSolt, Window& window) const;
+  bool search(const Window& window);
+
+  // 键 -> 是否死锁. 证明不了的窗口也记下来, 避免重复子搜索
+  std::unordered_map<uint64_t, bool> patterns_;
+  size_t deadlocks_ = 0;
+  uint64_t searches_ = 0;
+  mutable std::mutex mutex_;
+};
+
+#endif // #ifndef WSUN_SOKOBAN_PATTERNDB_H_
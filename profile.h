@@ -0,0 +1,140 @@
+#ifndef WSUN_SOKOBAN_PROFILE_H_
+#define WSUN_SOKOBAN_PROFILE_H_
+
+// 搜索各阶段的调用计数和耗时.
+// 只有定义了 SOKOBAN_PROFILE 才编译进来, 否则 PROFILE_SCOPE 展开为空, 发布版没有任何开销.
+// 计数每次都记, 计时按采样率抽样(每 rate 次计一次), 报告里按采样率放大成估计值.
+// 阶段可以嵌套(比如死锁检测里的 corral 子搜索要算可达区域), 报告里分开给出含子阶段的总耗时
+// 和扣掉子阶段之后的自身耗时, 占比按自身耗时算, 不会重复计入.
+
+#include <inttypes.h>
+#include <algorithm>
+#include <cstdio>
+
+namespace profile {
+
+enum Phase {
+  kReach,
+  kPushGen,
+  kDeadlock,
+  kHeuristic,
+  kHash,
+  kQueue,
+  kPhaseCount
+};
+
+static const char* const kPhaseNames[kPhaseCount] = {
+  "reach", "push_gen", "deadlock", "heuristic", "hash", "queue"
+};
+
+} // namespace profile
+
+#ifdef SOKOBAN_PROFILE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+namespace profile {
+
+// 时间戳计数器读数, 没有 rdtsc 的平台退回到纳秒
+inline uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+struct Stats {
+  uint64_t calls[kPhaseCount] = {};
+  // 含子阶段
+  uint64_t sampledCycles[kPhaseCount] = {};
+  // 抽到的直接子阶段耗时, 记在当时所在的外层阶段上
+  uint64_t nestedCycles[kPhaseCount] = {};
+  // 当前最内层的阶段, 不在任何阶段里时是 kPhaseCount
+  Phase current = kPhaseCount;
+  // 采样率减1, 采样率是2的幂
+  uint64_t mask = 0;
+};
+
+// 每个搜索线程各自一份, 互不加锁
+inline Stats& stats() {
+  static thread_local Stats s;
+  return s;
+}
+
+// 开始一次搜索前清零. rate 向上取到2的幂, 1 表示每次都计时
+inline void reset(uint64_t rate) {
+  uint64_t sample = 1;
+  while (sample < rate) sample <<= 1;
+  stats() = Stats();
+  stats().mask = sample - 1;
+}
+
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(Phase phase) : phase_(phase), start_(0) {
+    Stats& s = stats();
+    parent_ = s.current;
+    s.current = phase;
+    sampled_ = (s.calls[phase]++ & s.mask) == 0;
+    if (sampled_) start_ = cycles();
+  }
+
+  ~ScopedTimer() {
+    Stats& s = stats();
+    s.current = parent_;
+    if (!sampled_) return;
+    uint64_t elapsed = cycles() - start_;
+    s.sampledCycles[phase_] += elapsed;
+    if (parent_ != kPhaseCount) s.nestedCycles[parent_] += elapsed;
+  }
+
+ private:
+  Phase phase_;
+  Phase parent_;
+  bool sampled_;
+  uint64_t start_;
+};
+
+// 抽样误差可能让子阶段估计值超过外层, 自身耗时最少记0
+inline uint64_t selfCycles(const Stats& s, int phase) {
+  uint64_t nested = std::min(s.nestedCycles[phase], s.sampledCycles[phase]);
+  return (s.sampledCycles[phase] - nested) * (s.mask + 1);
+}
+
+// 每个阶段一行 JSON: 调用次数, 估计的总周期数(含子阶段)和自身周期数, 自身周期数的占比
+inline void print(FILE* out) {
+  const Stats& s = stats();
+  uint64_t total = 0;
+  for (int i = 0; i < kPhaseCount; ++i) total += selfCycles(s, i);
+  for (int i = 0; i < kPhaseCount; ++i) {
+    uint64_t estimated = s.sampledCycles[i] * (s.mask + 1);
+    uint64_t self = selfCycles(s, i);
+    fprintf(out, "{\"phase\": \"%s\", \"calls\": %lu, \"cycles\": %lu, \"self_cycles\": %lu, "
+        "\"cycles_per_call\": %.1f, \"share\": %.3f}\n",
+        kPhaseNames[i], s.calls[i], estimated, self, s.calls[i] == 0 ? 0.0 : static_cast<double>(estimated) / s.calls[i],
+        total == 0 ? 0.0 : static_cast<double>(self) / total);
+  }
+}
+
+} // namespace profile
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(phase) profile::ScopedTimer PROFILE_CONCAT(profileTimer, __LINE__)(profile::phase)
+#define PROFILE_RESET(rate) profile::reset(rate)
+#define PROFILE_PRINT(out) profile::print(out)
+
+#else
+
+#define PROFILE_SCOPE(phase) ((void)0)
+#define PROFILE_RESET(rate) ((void)0)
+#define PROFILE_PRINT(out) ((void)0)
+
+#endif // #ifdef SOKOBAN_PROFILE
+
+#endif // #ifndef WSUN_SOKOBAN_PROFILE_H_
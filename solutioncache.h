@@ -0,0 +1,336 @@
+#ifndef WSUN_SOKOBAN_SOLUTIONCACHE_H
+#define WSUN_SOKOBAN_SOLUTIONCACHE_H
+
+#include "solver.h"
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 跨运行的解答缓存.
+// 键是关卡的规范形式的散列: 墙, 目标, 初始箱子和玩家(不推箱子时)能走到的区域, 裁掉墙外的空白后
+// 在8种旋转/镜像里取字典序最小的一种. 同一关卡旋转或镜像之后, 或玩家换到同一区域的别处, 得到相同的键.
+// 解答按规范坐标存推动序列, 取出时换回本关卡的坐标, 重放一遍验证通过才算命中, 不用重新搜索.
+namespace solutioncache {
+
+static const uint32_t kFileMagic = 0x534c4f53;  // "SOLS"
+static const uint32_t kFileVersion = 1;
+
+// 文件里每条解答的定长部分, 后面跟 pushCount 个 uint32 的推动
+struct Record {
+  uint64_t key;
+  uint64_t expanded;
+  uint64_t generated;
+  uint64_t timeMs;
+  uint32_t moves;
+  uint32_t pushCount;
+};
+
+// 关卡裁剪框到规范坐标的变换. transform 的 bit2 表示先转置, bit0 上下翻转, bit1 左右翻转
+struct Frame {
+  int file;
+  int r0, c0;
+  int rows, cols;
+  int transform;
+
+  int outRows() const { return transform & 4 ? cols : rows; }
+  int outCols() const { return transform & 4 ? rows : cols; }
+
+  // 棋盘格子 -> 规范坐标下的格子序号
+  int toCanonical(int solt) const {
+    int a = solt / file - r0;
+    int b = solt % file - c0;
+    if (transform & 4) std::swap(a, b);
+    if (transform & 1) a = outRows() - 1 - a;
+    if (transform & 2) b = outCols() - 1 - b;
+    return a * outCols() + b;
+  }
+
+  int fromCanonical(int square) const {
+    int a = square / outCols();
+    int b = square % outCols();
+    if (transform & 1) a = outRows() - 1 - a;
+    if (transform & 2) b = outCols() - 1 - b;
+    if (transform & 4) std::swap(a, b);
+    return (a + r0) * file + (b + c0);
+  }
+
+  // 方向按 Left/Right/Up/Down 编号
+  int toCanonicalDir(int dir) const {
+    int dr = 0;
+    int dc = 0;
+    toDelta(dir, dr, dc);
+    if (transform & 4) std::swap(dr, dc);
+    if (transform & 1) dr = -dr;
+    if (transform & 2) dc = -dc;
+    return fromDelta(dr, dc);
+  }
+
+  int fromCanonicalDir(int dir) const {
+    int dr = 0;
+    int dc = 0;
+    toDelta(dir, dr, dc);
+    if (transform & 1) dr = -dr;
+    if (transform & 2) dc = -dc;
+    if (transform & 4) std::swap(dr, dc);
+    return fromDelta(dr, dc);
+  }
+
+ private:
+  static void toDelta(int dir, int& dr, int& dc) {
+    dr = dir == Up ? -1 : dir == Down ? 1 : 0;
+    dc = dir == Left ? -1 : dir == Right ? 1 : 0;
+  }
+
+  static int fromDelta(int dr, int dc) {
+    if (dr == 0) return dc < 0 ? Left : Right;
+    return dr < 0 ? Up : Down;
+  }
+};
+
+// 规范形式: "行x列:" 加上逐格的字符. 墙 '#', 墙外 ' ', 内部格子按 目标/箱子/玩家区域 三位编码
+static std::string encode(const Board& board, const Bitboard& region, const Frame& frame) {
+  std::string cells(frame.outRows() * frame.outCols(), ' ');
+  for (int r = 0; r < frame.rows; ++r) {
+    for (int c = 0; c < frame.cols; ++c) {
+      int solt = (r + frame.r0) * board.file + c + frame.c0;
+      SquareType st = board.map[solt];
+      char ch = ' ';
+      if (st & SquareType::kWall) {
+        ch = '#';
+      } else if (!(st & SquareType::kEmpty)) {
+        ch = 'a' + ((st & SquareType::kGoal) ? 1 : 0) + ((st & SquareType::kBox) ? 2 : 0) +
+          (region.test(solt) ? 4 : 0);
+      }
+      cells[frame.toCanonical(solt)] = ch;
+    }
+  }
+  return std::to_string(frame.outRows()) + "x" + std::to_string(frame.outCols()) + ":" + cells;
+}
+
+// 64位 FNV-1a
+static uint64_t hashString(const std::string& s) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (unsigned char ch : s) {
+    h ^= ch;
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+// 求关卡的规范键和对应的变换
+static uint64_t canonicalKey(const Board& board, Frame& frame) {
+  int rank = static_cast<int>(board.map.size()) / board.file;
+  int r1 = -1;
+  int c1 = -1;
+  frame.file = board.file;
+  frame.r0 = rank;
+  frame.c0 = board.file;
+  for (int solt = 0; solt < static_cast<int>(board.map.size()); ++solt) {
+    if (board.map[solt] & SquareType::kEmpty) continue;
+    int r = solt / board.file;
+    int c = solt % board.file;
+    frame.r0 = std::min(frame.r0, r);
+    frame.c0 = std::min(frame.c0, c);
+    r1 = std::max(r1, r);
+    c1 = std::max(c1, c);
+  }
+  frame.rows = r1 - frame.r0 + 1;
+  frame.cols = c1 - frame.c0 + 1;
+
+  Reach reach;
+  calcReachableTiles(board, reach);
+
+  std::string best;
+  int bestTransform = 0;
+  for (int t = 0; t < 8; ++t) {
+    frame.transform = t;
+    std::string s = encode(board, reach.tiles, frame);
+    if (t == 0 || s < best) {
+      best.swap(s);
+      bestTransform = t;
+    }
+  }
+  frame.transform = bestTransform;
+  return hashString(best);
+}
+
+static int directionIndex(const Board& board, Direction dir) {
+  const auto& dirs = board.context->directions;
+  return static_cast<int>(std::find(dirs.begin(), dirs.end(), dir) - dirs.begin());
+}
+
+// 在 board 上按顺序重放推动: 每一步的格子都在棋盘上, 玩家要走得到箱子后面, 箱子在,
+// 前面的格子空着. 通过时 board 停在最后的局面, moves 是完整的 LURD 走法.
+// 不检查是否解开, 由调用方对最后的局面做 checkGameOver
+static bool replay(Board& board, const std::vector<Push>& pushes, std::string& moves) {
+  int squares = static_cast<int>(board.map.size());
+  for (const auto& push : pushes) {
+    int dest = push.boxSolt + push.dir;
+    int behind = push.boxSolt - push.dir;
+    if (std::min(dest, behind) < 0 || std::max(dest, behind) >= squares) return false;
+    if (!(board.map[push.boxSolt] & SquareType::kBox) ||
+        (board.map[dest] & (SquareType::kWall | SquareType::kBox | SquareType::kEmpty))) {
+      return false;
+    }
+    if (!findPlayerPath(board, behind, moves)) return false;
+    moves.push_back(std::toupper(board.context->directionChar(push.dir)));
+    doPush(board, Push(push.boxSolt, push.dir, board.playerSolt));
+  }
+  return true;
+}
+
+} // namespace solutioncache
+
+class SolutionCache {
+ public:
+  SolutionCache() = default;
+  SolutionCache(const SolutionCache&) = delete;
+  SolutionCache& operator=(const SolutionCache&) = delete;
+
+  // 命中并且重放验证通过时返回 true. result 里是本关卡坐标下的解, 统计数字是当初搜索时的
+  bool lookup(const Board& board, SearchResult& result) const {
+    solutioncache::Frame frame;
+    uint64_t key = solutioncache::canonicalKey(board, frame);
+    Entry entry;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = entries_.find(key);
+      if (it == entries_.end()) return false;
+      entry = it->second;
+    }
+
+    // 散列冲突或文件损坏的解要么坐标出界, 要么重放不过去, 要么最后没解开, 都当作没有命中
+    int squares = frame.outRows() * frame.outCols();
+    int boardSquares = static_cast<int>(board.map.size());
+    std::vector<Push> pushes;
+    for (uint32_t code : entry.pushes) {
+      int square = static_cast<int>(code >> 2);
+      if (square >= squares) return false;
+      int boxSolt = frame.fromCanonical(square);
+      if (boxSolt < 0 || boxSolt >= boardSquares) return false;
+      Direction dir = board.context->directions[frame.fromCanonicalDir(code & 3)];
+      pushes.emplace_back(boxSolt, dir, boxSolt - dir);
+    }
+    std::string moves;
+    Board end(board);
+    end.heuristic = nullptr;
+    if (!solutioncache::replay(end, pushes, moves) || !checkGameOver(end)) return false;
+
+    result = SearchResult();
+    result.status = SearchStatus::kSolved;
+    result.cached = true;
+    result.pushes = std::move(pushes);
+    result.moves = std::move(moves);
+    result.explorNodes = entry.expanded;
+    result.generateNodes = entry.generated;
+    result.timeMs = entry.timeMs;
+    return true;
+  }
+
+  // board 是搜索开始时的局面. 只收解出来的结果, 同一关卡保留推动次数少的解
+  void store(const Board& board, const SearchResult& result) {
+    if (!result.solved() || result.cached) return;
+    solutioncache::Frame frame;
+    uint64_t key = solutioncache::canonicalKey(board, frame);
+    Entry entry;
+    for (const auto& push : result.pushes) {
+      int square = frame.toCanonical(push.boxSolt);
+      int dir = frame.toCanonicalDir(solutioncache::directionIndex(board, push.dir));
+      entry.pushes.push_back(static_cast<uint32_t>(square) << 2 | dir);
+    }
+    entry.moves = result.moves.size();
+    entry.expanded = result.explorNodes;
+    entry.generated = result.generateNodes;
+    entry.timeMs = result.timeMs;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end() || entry.pushes.size() < it->second.pushes.size()) {
+      entries_[key] = std::move(entry);
+    }
+  }
+
+  // 长度字段先和文件剩下的字节数比过再分配, 损坏的文件整个不要, 已有的条目不受影响
+  bool load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) return false;
+    uint64_t remaining = static_cast<uint64_t>(in.tellg());
+    in.seekg(0);
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint64_t count = 0;
+    in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!in || magic != solutioncache::kFileMagic || version != solutioncache::kFileVersion) return false;
+    remaining -= sizeof(magic) + sizeof(version) + sizeof(count);
+    if (count > remaining / sizeof(solutioncache::Record)) return false;
+
+    std::unordered_map<uint64_t, Entry> entries;
+    for (uint64_t i = 0; i < count; ++i) {
+      solutioncache::Record record;
+      if (!in.read(reinterpret_cast<char*>(&record), sizeof(record))) return false;
+      remaining -= sizeof(record);
+      if (record.pushCount > remaining / sizeof(uint32_t)) return false;
+      Entry entry;
+      entry.pushes.resize(record.pushCount);
+      if (!in.read(reinterpret_cast<char*>(entry.pushes.data()), record.pushCount * sizeof(uint32_t))) return false;
+      remaining -= record.pushCount * sizeof(uint32_t);
+      entry.moves = record.moves;
+      entry.expanded = record.expanded;
+      entry.generated = record.generated;
+      entry.timeMs = record.timeMs;
+      entries[record.key] = std::move(entry);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& e : entries) entries_[e.first] = std::move(e.second);
+    return true;
+  }
+
+  // 先写临时文件再改名, 中途被打断也不会留下损坏的缓存
+  bool save(const std::string& path) const {
+    std::string tmp = path + ".tmp";
+    {
+      std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+      if (!out) return false;
+      std::lock_guard<std::mutex> lock(mutex_);
+      uint64_t count = entries_.size();
+      out.write(reinterpret_cast<const char*>(&solutioncache::kFileMagic), sizeof(solutioncache::kFileMagic));
+      out.write(reinterpret_cast<const char*>(&solutioncache::kFileVersion), sizeof(solutioncache::kFileVersion));
+      out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+      for (const auto& e : entries_) {
+        const Entry& entry = e.second;
+        solutioncache::Record record{ e.first, entry.expanded, entry.generated, entry.timeMs,
+          entry.moves, static_cast<uint32_t>(entry.pushes.size()) };
+        out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        out.write(reinterpret_cast<const char*>(entry.pushes.data()), entry.pushes.size() * sizeof(uint32_t));
+      }
+      if (!out) return false;
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
+
+ private:
+  struct Entry {
+    // 规范坐标下的推动: 箱子所在格子 << 2 | 方向
+    std::vector<uint32_t> pushes;
+    uint32_t moves = 0;
+    uint64_t expanded = 0;
+    uint64_t generated = 0;
+    uint64_t timeMs = 0;
+  };
+
+  std::unordered_map<uint64_t, Entry> entries_;
+  mutable std::mutex mutex_;
+};
+
+#endif
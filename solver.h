@@ -4,65 +4,103 @@
 #include "parser.h"
 #include "zobrist.h"
 #include "deadlock.h"
+#include "boxset.h"
+#include "transposition.h"
+#include "node.h"
+#include "heuristic.h"
+#include "patterndb.h"
+#include "macro.h"
+#include "corral.h"
+#include "bitboard.h"
+#include "profile.h"
+#include "context.h"
 #include <queue>
 #include <memory>
 #include <cassert>
 #include <algorithm>
 #include <climits>
 #include <chrono>
+#include <cctype>
+#include <string>
 
 namespace {
 
-template <class Item, class PriorityValue>
-struct PriorityQueue {
-  typedef std::pair<PriorityValue, Item> Element;
-  struct CompareFn {
-    bool operator()(const Element& l, const Element& r) {
-      return l.first > r.first;
-    }
-  };
-  typedef std::priority_queue<Element, std::vector<Element>,CompareFn> InnerQueue;
+// 按 f 分桶的优先队列, 桶内再按 g 分桶, f 相同时先取 g 大(更深)的.
+// 代价都是不大的整数, 入队出队都是均摊 O(1), 每个元素只存一个节点下标
+template <class Item>
+class BucketQueue {
+ public:
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  size_t size() const {
+    return size_;
+  }
 
-  inline bool empty() const {
-    return queue_.empty();
+  size_t memoryBytes() const {
+    return size_ * sizeof(Item) + buckets_.capacity() * sizeof(Bucket);
   }
 
-  inline void push(const Item& item, PriorityValue pri) {
-    queue_.emplace(pri, item);
+  void push(const Item& item, int f, int g) {
+    if (f >= static_cast<int>(buckets_.size())) buckets_.resize(f + 1);
+    Bucket& bucket = buckets_[f];
+    if (g >= static_cast<int>(bucket.items.size())) bucket.items.resize(g + 1);
+    bucket.items[g].push_back(item);
+    bucket.maxG = std::max(bucket.maxG, g);
+    ++bucket.size;
+    minF_ = std::min(minF_, f);
+    ++size_;
   }
 
   Item pop() {
-    Item item = queue_.top().second;
-    queue_.pop();
+    while (buckets_[minF_].size == 0) ++minF_;
+    Bucket& bucket = buckets_[minF_];
+    while (bucket.items[bucket.maxG].empty()) --bucket.maxG;
+    std::vector<Item>& items = bucket.items[bucket.maxG];
+    Item item = items.back();
+    items.pop_back();
+    if (--bucket.size == 0) bucket.maxG = 0;
+    --size_;
     return item;
   }
 
-  InnerQueue queue_;
+ private:
+  struct Bucket {
+    std::vector<std::vector<Item>> items;
+    int maxG = 0;
+    size_t size = 0;
+  };
+
+  std::vector<Bucket> buckets_;
+  int minF_ = INT_MAX;
+  size_t size_ = 0;
 };
 
 } // namespace 
 
-enum ReachState{
-  kUnvisited,
-  kReachable,
-  kReachableBox
-};
-
 struct Reach {
   int minReachableSolt;
-  std::vector<ReachState> tiles;
+  // 玩家能走到的格子
+  Bitboard tiles;
+  // 其中挨着箱子的格子, 和 tiles 在同一次计算里得到
+  Bitboard boxSides;
+
+  bool contains(int solt) const {
+    return tiles.test(solt);
+  }
 
   bool isReachableBox(int solt) const {
-    return tiles[solt] == ReachState::kReachableBox;
+    return boxSides.test(solt);
   }
 
   bool isReachable(int solt) const {
-    return tiles[solt] == ReachState::kReachable;
+    return tiles.test(solt) && !boxSides.test(solt);
   }
 };
 
 struct DynamicData {
-  std::set<int> boxes;
+  BoxSet boxes;
   int playerSolt;
   
   bool operator<(const DynamicData& rhs) const {
@@ -79,15 +117,32 @@ struct DynamicData {
 
 };
 
+// 有专门内核的关卡宽度. 更窄的关卡每行右边补墙外的空格子凑到其中一个, 超过32的走通用内核
+static const int kKernelWidths[] = { 8, 16, 20, 24, 32 };
+
+static int paddedWidth(int file, int rank) {
+  for (int width : kKernelWidths) {
+    if (file <= width) return rank * width <= Bitboard::kMaxSquares ? width : file;
+  }
+  return file;
+}
+
+static const SearchKernels& searchKernels(int file);
+
 struct Board {
-  std::set<int> goals;
-  std::set<int> boxes;
+  BoxSet goals;
+  BoxSet boxes;
   int playerSolt;
   int file;
   Map map;
   Zobrist zobrist;
-  std::vector<Zobrist> playerZobrists;
-  std::vector<Zobrist> boxZobrists;
+  // 方向偏移和 Zobrist 键表, 拷贝的棋盘共享同一份
+  std::shared_ptr<const SolverContext> context;
+  // 搜索期间挂上, doPush/undoPush 时增量更新估值
+  Heuristic* heuristic = nullptr;
+  // 墙和箱子的位图, 给 calcReachableTiles 用. boxMask 和 boxes 同步维护
+  Bitboard wallMask;
+  Bitboard boxMask;
 
   void extractDynamicData(DynamicData& data) const {
     data.boxes = boxes;
@@ -95,43 +150,90 @@ struct Board {
   }
 
   void recoverFromData(const DynamicData& data) {
-    for (auto box : boxes) map[box] ^= SquareType::kBox;
-    for (auto box : data.boxes) map[box] |= SquareType::kBox;
+    // 只改动两个局面之间不同的箱子, 估值也就可以按箱子逐个增量更新
+    std::array<int, kMaxBoxes> removed;
+    std::array<int, kMaxBoxes> added;
+    int removedCount = std::set_difference(boxes.begin(), boxes.end(),
+        data.boxes.begin(), data.boxes.end(), removed.begin()) - removed.begin();
+    int addedCount = std::set_difference(data.boxes.begin(), data.boxes.end(),
+        boxes.begin(), boxes.end(), added.begin()) - added.begin();
+    const SolverContext& ctx = *context;
+    for (int i = 0; i < removedCount; ++i) {
+      map[removed[i]] ^= SquareType::kBox;
+      boxMask.clear(removed[i]);
+      zobrist.XOR(ctx.boxKey(removed[i]));
+    }
+    for (int i = 0; i < addedCount; ++i) {
+      map[added[i]] |= SquareType::kBox;
+      boxMask.set(added[i]);
+      zobrist.XOR(ctx.boxKey(added[i]));
+    }
     map[playerSolt] ^= SquareType::kPlayer;
     map[data.playerSolt] |= SquareType::kPlayer;
+    zobrist.XOR(ctx.playerKey(playerSolt));
+    zobrist.XOR(ctx.playerKey(data.playerSolt));
     boxes = data.boxes;
     playerSolt = data.playerSolt;
+    if (heuristic == nullptr) return;
+    if (removedCount != addedCount || removedCount > kIncrementalRecoverLimit) {
+      heuristic->reset(*this);
+      return;
+    }
+    for (int i = 0; i < removedCount; ++i) {
+      heuristic->moveBox(*this, removed[i], added[i]);
+    }
   }
 
+
+  // 玩家部分换成所在连通区域的最小格子, 同一区域内不同站位的局面得到相同的键
+  Zobrist normalizedZobrist(int minReachableSolt) const {
+    Zobrist key(zobrist);
+    key.XOR(context->playerKey(playerSolt));
+    key.XOR(context->playerKey(minReachableSolt));
+    return key;
+  }
+
+  // 关卡要先过 levelError 的检查, 加载关卡的地方已经把处理不了的关卡挡在外面.
+  // 先按原宽度封好内部(和 levelError 检查的是同一张图), 再补宽
   Board(const Level& level) {
-    for (int i = 0; i < level.map.size(); ++i) {
-      SquareType st = level.map[i];
+    assert(levelError(level) == nullptr);
+    Map sealed = level.map;
+    int player = static_cast<int>(std::find_if(sealed.begin(), sealed.end(), [](SquareType st) {
+      return (st & SquareType::kPlayer) != 0;
+    }) - sealed.begin());
+    sealInterior(sealed, level.file, player);
+    // 补出来的格子是 kEmpty, 和墙外的格子一样走不到
+    file = paddedWidth(level.file, level.rank);
+    map.assign(static_cast<size_t>(level.rank) * file, SquareType::kEmpty);
+    for (int i = 0; i < level.rank; ++i) {
+      std::copy(sealed.begin() + i * level.file, sealed.begin() + (i + 1) * level.file,
+          map.begin() + i * file);
+    }
+    playerSolt = player / level.file * file + player % level.file;
+    for (int i = 0; i < map.size(); ++i) {
+      SquareType st = map[i];
       if (st & SquareType::kGoal) goals.insert(i);
       if (st & SquareType::kBox) boxes.insert(i);
-      if (st & SquareType::kPlayer) playerSolt = i;
     }
-    file = level.file;
-    map = level.map;
-    kDirection[Up] = -level.file;
-    kDirection[Down] = level.file;
-
-    playerZobrists.resize(map.size());
-    boxZobrists.resize(map.size());
-    RC4 rc4;
-    std::for_each(playerZobrists.begin(), playerZobrists.end(), [&rc4](Zobrist& zobrist) {
-        zobrist = Zobrist(rc4);
-    });
-    std::for_each(boxZobrists.begin(), boxZobrists.end(), [&rc4](Zobrist& zobrist) {
-        zobrist = Zobrist(rc4);
-    });
-    zobrist.XOR(playerZobrists[playerSolt]);
+    context = std::make_shared<const SolverContext>(map, file, searchKernels(file));
+
+    // 位图内核按字平移, 一行不能超过一个字
+    assert(file > 0 && file < 64);
+    wallMask.reset(map.size());
+    boxMask.reset(map.size());
+    for (int i = 0; i < map.size(); ++i) {
+      if (map[i] & SquareType::kWall) wallMask.set(i);
+    }
+    for (int box : boxes) boxMask.set(box);
+
+    zobrist.XOR(context->playerKey(playerSolt));
     for (int box : boxes) {
-      zobrist.XOR(boxZobrists[box]);
+      zobrist.XOR(context->boxKey(box));
     }
   }
 
   bool isNeighborWithBox(int solt) const {
-    for (auto dir : kDirection) {
+    for (auto dir : context->directions) {
       int dest = solt + dir;
       if (map[dest] & SquareType::kBox) return true;
     }
@@ -224,68 +326,144 @@ struct Board {
 
 };
 
-struct Push;
-using PushPtr = std::shared_ptr<Push>;
-
 struct Push {
   int boxSolt;
   Direction dir;
   int playerSolt;
 
-  DynamicData data;
-
-  Push(int boxSolt, Direction dir, int playerSolt, const Board& board)
+  Push(int boxSolt, Direction dir, int playerSolt)
     : boxSolt(boxSolt),
       dir(dir),
       playerSolt(playerSolt)
-  {
-    board.extractDynamicData(data);
-  }
-
+  {}
 
   Push(const Push&) = default;
 };
 
-static void calcReachableTiles(const Board& board, Reach& reach) {
-  reach.minReachableSolt = board.playerSolt;
-  reach.tiles.resize(board.map.size(), ReachState::kUnvisited);
+// 位图上从玩家位置反复做 平移/或/去掉墙和箱子 直到不再变化,
+// 再和箱子的邻格求交得到推箱子要用的 boxSides.
+// kFile 不为0时等于 board.file, 偏移和位图平移都是常量; 为0是通用版本
+template <int kFile>
+static void calcReachableTilesFor(const Board& board, Reach& reach) {
+  PROFILE_SCOPE(kReach);
+  int words = board.wallMask.words();
+  reach.tiles.reset(board.map.size());
+  reach.boxSides.reset(board.map.size());
+  reach.tiles.set(board.playerSolt);
+  bitboard::flood<kFile>(reach.tiles.data(), board.wallMask.data(), board.boxMask.data(), words, board.file);
+  bitboard::boxSides<kFile>(reach.tiles.data(), board.boxMask.data(), reach.boxSides.data(), words, board.file);
+  reach.minReachableSolt = reach.tiles.first();
+}
 
-  std::queue<int> q;
-  q.push(reach.minReachableSolt);
-  while (!q.empty()) {
-    int solt = q.front();
-    int st = board.map[solt];
-    if (!(st & SquareType::kWall) &&
-        reach.tiles[solt] == ReachState::kUnvisited) {
-
-      reach.tiles[solt] = board.isNeighborWithBox(solt) ?
-        ReachState::kReachableBox : ReachState::kReachable;
-      for (auto dir : kDirection) {
-        int dest = solt + dir;
-        if (!(board.map[dest] & kBox)) q.push(dest);
-      }
-      reach.minReachableSolt = std::min(solt, reach.minReachableSolt);
+// 去掉 solt 后它四周属于 tiles 的邻格是否可能不再连通.
+// 绕 solt 一圈的8个格子首尾相邻, 邻格都落在同一段连续的可达格子里就一定还连通
+template <int kFile>
+static bool maySplit(const Bitboard& tiles, int solt, int runtimeFile) {
+  const int file = kFile != 0 ? kFile : runtimeFile;
+  const int ring[8] = { -file, -file + 1, 1, file + 1, file, file - 1, -1, -file - 1 };
+  int start = 0;
+  while (start < 8 && tiles.test(solt + ring[start])) ++start;
+  if (start == 8) return false;
+  int runs = 0;
+  bool inRun = false;
+  bool touches = false;
+  for (int k = 1; k <= 8; ++k) {
+    int i = (start + k) & 7;
+    if (tiles.test(solt + ring[i])) {
+      inRun = true;
+      // 偶数位置是上下左右的邻格
+      touches = touches || (i & 1) == 0;
+    } else if (inRun) {
+      if (touches) ++runs;
+      inRun = false;
+      touches = false;
+    }
+  }
+  return runs > 1;
+}
+
+// board 上刚做完 push. 由父局面的 reach 推出子局面的 reach: 箱子原来的格子空出来给玩家,
+// 新的格子堵上. 堵住的格子可能把区域切开时整个重算; 空出的格子连上别的区域时从原区域接着扩散
+template <int kFile>
+static void updateReachFor(const Board& board, const Reach& parent, const Push& push, Reach& reach) {
+  int freed = push.boxSolt;
+  int blocked = push.boxSolt + push.dir;
+  const int file = kFile != 0 ? kFile : board.file;
+  reach.tiles = parent.tiles;
+  reach.tiles.set(freed);
+  if (parent.contains(blocked)) {
+    reach.tiles.clear(blocked);
+    if (maySplit<kFile>(reach.tiles, blocked, file)) {
+      calcReachableTilesFor<kFile>(board, reach);
+      return;
+    }
+  }
+  PROFILE_SCOPE(kReach);
+  const int dirs[4] = { -1, 1, -file, file };
+  for (int dir : dirs) {
+    int next = freed + dir;
+    if (!reach.tiles.test(next) && !board.wallMask.test(next) && !board.boxMask.test(next)) {
+      bitboard::flood<kFile>(reach.tiles.data(), board.wallMask.data(), board.boxMask.data(),
+          reach.tiles.words(), file);
+      break;
     }
-    q.pop();
   }
+  reach.boxSides.reset(board.map.size());
+  bitboard::boxSides<kFile>(reach.tiles.data(), board.boxMask.data(), reach.boxSides.data(),
+      reach.tiles.words(), file);
+  reach.minReachableSolt = reach.tiles.first();
 }
 
-static void getPushes(const Board& board, std::vector<Push>& pushes) {
-  Reach reach;
-  calcReachableTiles(board, reach);
+template <int kFile>
+static void getPushesFor(const Board& board, const Reach& reach, std::vector<Push>& pushes) {
+  PROFILE_SCOPE(kPushGen);
+  const int file = kFile != 0 ? kFile : board.file;
+  const Direction dirs[4] = { -1, 1, -file, file };
   for (int boxSolt : board.boxes) {
-    for (auto dir : kDirection) {
+    for (auto dir : dirs) {
       int destSolt = boxSolt + dir;
       int pushSolt = boxSolt - dir;
       if (reach.isReachableBox(pushSolt) &&
           !(board.map[destSolt] & (kWall | kBox))) {
-        pushes.emplace_back(boxSolt, dir, board.playerSolt, board);
+        pushes.emplace_back(boxSolt, dir, board.playerSolt);
       }
     }
   }
   // board.print(reach);
 }
 
+template <int kFile>
+static const SearchKernels& kernelsFor() {
+  static const SearchKernels kernels = {
+    calcReachableTilesFor<kFile>, updateReachFor<kFile>, getPushesFor<kFile>
+  };
+  return kernels;
+}
+
+// 每个关卡在建立上下文时选一次. file 是补齐后的宽度
+static const SearchKernels& searchKernels(int file) {
+  switch (file) {
+    case 8: return kernelsFor<8>();
+    case 16: return kernelsFor<16>();
+    case 20: return kernelsFor<20>();
+    case 24: return kernelsFor<24>();
+    case 32: return kernelsFor<32>();
+    default: return kernelsFor<0>();
+  }
+}
+
+static void calcReachableTiles(const Board& board, Reach& reach) {
+  board.context->kernels.calcReach(board, reach);
+}
+
+static void updateReach(const Board& board, const Reach& parent, const Push& push, Reach& reach) {
+  board.context->kernels.updateReach(board, parent, push, reach);
+}
+
+static void getPushes(const Board& board, const Reach& reach, std::vector<Push>& pushes) {
+  board.context->kernels.getPushes(board, reach, pushes);
+}
+
 static double distance(int start, int end, int file) {
   int startx = start / file;
   int starty = start % file;
@@ -294,9 +472,9 @@ static double distance(int start, int end, int file) {
   return std::abs(startx - endx) + std::abs(starty - endy);
 }
 
-static double costForManhattan(const Board& board, const Push& push) {
-  const std::set<int>& goals = board.goals;
-  const std::set<int>& boxs = push.data.boxes;
+static double costForManhattan(const Board& board) {
+  const BoxSet& goals = board.goals;
+  const BoxSet& boxs = board.boxes;
 
   double d = 0;
   for (auto it_box = boxs.begin(), it_goal = goals.begin();
@@ -317,32 +495,45 @@ static void doPush(Board& board, const Push& push) {
   board.map[push.boxSolt] ^= SquareType::kBox;
   board.map[moveBoxSolt] |= SquareType::kBox;
   board.playerSolt = movePlayerSolt;
-  board.boxes.erase(push.boxSolt);
-  board.boxes.insert(moveBoxSolt);
-
-  board.zobrist.XOR(board.playerZobrists[push.playerSolt]);
-  board.zobrist.XOR(board.playerZobrists[movePlayerSolt]);
-  board.zobrist.XOR(board.boxZobrists[push.boxSolt]);
-  board.zobrist.XOR(board.boxZobrists[moveBoxSolt]);
+  board.boxes.move(push.boxSolt, moveBoxSolt);
+  board.boxMask.clear(push.boxSolt);
+  board.boxMask.set(moveBoxSolt);
+
+  const SolverContext& ctx = *board.context;
+  board.zobrist.XOR(ctx.playerKey(push.playerSolt));
+  board.zobrist.XOR(ctx.playerKey(movePlayerSolt));
+  board.zobrist.XOR(ctx.boxKey(push.boxSolt));
+  board.zobrist.XOR(ctx.boxKey(moveBoxSolt));
+  if (board.heuristic) {
+    PROFILE_SCOPE(kHeuristic);
+    board.heuristic->moveBox(board, push.boxSolt, moveBoxSolt);
+  }
   // std::cout << "do push after: " << board.playerSolt << std::endl;
 }
 
+// 玩家不一定还站在 push.boxSolt 上(沿父链回退时会连续 undo), 以棋盘上的实际位置为准
 static void undoPush(Board& board, const Push& push) {
   // std::cout << "undo push before: " << board.playerSolt << std::endl;
-  int movePlayerSolt = push.boxSolt;
+  int movePlayerSolt = board.playerSolt;
   int moveBoxSolt = push.boxSolt + push.dir;
-  board.map[push.playerSolt] |= SquareType::kPlayer;
   board.map[movePlayerSolt] ^= SquareType::kPlayer;
+  board.map[push.playerSolt] |= SquareType::kPlayer;
   board.map[push.boxSolt] |= SquareType::kBox;
   board.map[moveBoxSolt] ^= SquareType::kBox;
-  board.playerSolt = movePlayerSolt;
-  board.boxes.insert(push.boxSolt);
-  board.boxes.erase(moveBoxSolt);
-
-  board.zobrist.XOR(board.playerZobrists[push.playerSolt]);
-  board.zobrist.XOR(board.playerZobrists[movePlayerSolt]);
-  board.zobrist.XOR(board.boxZobrists[push.boxSolt]);
-  board.zobrist.XOR(board.boxZobrists[moveBoxSolt]);
+  board.playerSolt = push.playerSolt;
+  board.boxes.move(moveBoxSolt, push.boxSolt);
+  board.boxMask.clear(moveBoxSolt);
+  board.boxMask.set(push.boxSolt);
+
+  const SolverContext& ctx = *board.context;
+  board.zobrist.XOR(ctx.playerKey(push.playerSolt));
+  board.zobrist.XOR(ctx.playerKey(movePlayerSolt));
+  board.zobrist.XOR(ctx.boxKey(push.boxSolt));
+  board.zobrist.XOR(ctx.boxKey(moveBoxSolt));
+  if (board.heuristic) {
+    PROFILE_SCOPE(kHeuristic);
+    board.heuristic->moveBox(board, moveBoxSolt, push.boxSolt);
+  }
   // std::cout << "undo push after: " << board.playerSolt << std::endl;
 }
 
@@ -354,103 +545,370 @@ static uint64_t getNowTime() {
   return std::chrono::system_clock::now().time_since_epoch().count();
 }
 
-static bool isTunnels(const Push& push, const Board& board) {
-  int playerSolt = push.boxSolt - push.dir;
-  return ((board.map[playerSolt + 1] & SquareType::kWall) &&
-          (board.map[playerSolt - 1] & SquareType::kWall) &&
-          ((board.map[push.boxSolt - 1] & SquareType::kWall) ||
-           (board.map[push.boxSolt + 1] & SquareType::kWall))) ||
-         ((board.map[playerSolt + board.file] & SquareType::kWall) &&
-          (board.map[playerSolt - board.file] & SquareType::kWall) &&
-          ((board.map[push.boxSolt - board.file] & SquareType::kWall) ||
-           (board.map[push.boxSolt + board.file] & SquareType::kWall)));
+// 从当前局面找一条玩家走到 target 的最短路径, 以 lurd 小写字母追加到 moves
+static bool findPlayerPath(const Board& board, int target, std::string& moves) {
+  std::vector<int> from(board.map.size(), -1);
+  std::queue<int> q;
+  from[board.playerSolt] = board.playerSolt;
+  q.push(board.playerSolt);
+  const auto dirs = board.context->directions;
+  while (!q.empty() && from[target] == -1) {
+    int solt = q.front();
+    q.pop();
+    for (auto dir : dirs) {
+      int dest = solt + dir;
+      if (from[dest] == -1 && !(board.map[dest] & (kWall | kBox))) {
+        from[dest] = solt;
+        q.push(dest);
+      }
+    }
+  }
+  if (from[target] == -1) return false;
+
+  std::string path;
+  for (int solt = target; solt != board.playerSolt; solt = from[solt]) {
+    path.push_back(board.context->directionChar(solt - from[solt]));
+  }
+  moves.append(path.rbegin(), path.rend());
+  return true;
+}
+
+// 把推箱子序列展开成完整的 LURD 走法, 小写为走路, 大写为推箱子
+static bool expandToMoves(Board board, const std::vector<Push>& pushes, std::string& moves) {
+  board.heuristic = nullptr;
+  for (const auto& push : pushes) {
+    if (!findPlayerPath(board, push.boxSolt - push.dir, moves)) return false;
+    moves.push_back(std::toupper(board.context->directionChar(push.dir)));
+    doPush(board, Push(push.boxSolt, push.dir, board.playerSolt));
+  }
+  return true;
 }
 
-static void astarSearch(Board& board) {
-  uint64_t startTime = getNowTime();
-  DeadLock dl;
-  dl.generate(board);
-  int generateNodes = 0;
-  int explorNodes = 0;
+static Push nodePush(const SearchNode& node) {
+  return Push(node.boxSolt, node.dir, node.boxSolt - node.dir);
+}
 
+// 节点对应的完整推动序列, 宏推动展开成多次推动
+static void nodePushes(const SearchNode& node, const MacroMoves& macros, std::vector<Push>& pushes) {
+  if (node.macro == kNoMacro) {
+    pushes.push_back(nodePush(node));
+  } else {
+    macros.expand(node.boxSolt, node.dir, node.destSolt, static_cast<MacroType>(node.macro), pushes);
+  }
+}
+
+static void undoPushes(Board& board, const std::vector<Push>& pushes) {
+  for (auto it = pushes.rbegin(); it != pushes.rend(); ++it) {
+    undoPush(board, *it);
+  }
+}
+
+static void redoNode(Board& board, const SearchNode& node, const MacroMoves& macros) {
+  if (node.macro == kNoMacro) {
+    doPush(board, Push(node.boxSolt, node.dir, board.playerSolt));
+    return;
+  }
   std::vector<Push> pushes;
-  getPushes(board, pushes);
-  if (pushes.empty()) return;
-
-  DynamicData data;
-  board.extractDynamicData(data);
-  std::set<DynamicData> visited;
-  visited.insert(data);
-  PriorityQueue<PushPtr, double> frontier;
+  nodePushes(node, macros, pushes);
   for (const auto& push : pushes) {
-    ++generateNodes;
-    frontier.push(PushPtr(new Push(push)), costForManhattan(board, push));
+    doPush(board, Push(push.boxSolt, push.dir, board.playerSolt));
+  }
+}
+
+static void undoNode(Board& board, const SearchNode& node, const MacroMoves& macros) {
+  if (node.macro == kNoMacro) {
+    undoPush(board, nodePush(node));
+    return;
+  }
+  std::vector<Push> pushes;
+  nodePushes(node, macros, pushes);
+  undoPushes(board, pushes);
+}
+
+// 沿父链把棋盘从 from 节点的局面切换到 to 节点的局面: 先 undo 到公共祖先, 再 redo 下来
+static void moveToNode(Board& board, const NodeArena& nodes, const MacroMoves& macros,
+    uint32_t from, uint32_t to, std::vector<uint32_t>& path) {
+  path.clear();
+  while (nodes[from].depth > nodes[to].depth) {
+    undoNode(board, nodes[from], macros);
+    from = nodes[from].parent;
   }
+  while (nodes[to].depth > nodes[from].depth) {
+    path.push_back(to);
+    to = nodes[to].parent;
+  }
+  while (from != to) {
+    undoNode(board, nodes[from], macros);
+    from = nodes[from].parent;
+    path.push_back(to);
+    to = nodes[to].parent;
+  }
+  for (auto it = path.rbegin(); it != path.rend(); ++it) {
+    redoNode(board, nodes[*it], macros);
+  }
+}
 
+static void collectPushes(const NodeArena& nodes, const MacroMoves& macros, uint32_t idx,
+    std::vector<Push>& pushes) {
+  std::vector<uint32_t> path;
+  for (; nodes[idx].parent != kNoParent; idx = nodes[idx].parent) {
+    path.push_back(idx);
+  }
+  pushes.clear();
+  for (auto it = path.rbegin(); it != path.rend(); ++it) {
+    nodePushes(nodes[*it], macros, pushes);
+  }
+}
+
+// 关卡局面数的上界: 箱子只能在非死格上, 玩家按所在区域归一化, 最多有空格子那么多种.
+// 小关卡的置换表按它开, 不必每次都占满 transpositionBytes
+static size_t positionBound(const Board& board, const DeadLock& dl) {
+  const SolverContext& context = *board.context;
+  int live = 0;
+  for (int solt : context.solts) {
+    if (!dl.isDeadSolt(solt)) ++live;
+  }
+  int boxes = static_cast<int>(board.boxes.size());
+  double bound = context.cells() - boxes;
+  for (int i = 0; i < boxes; ++i) {
+    bound = bound * std::max(live - i, 0) / (i + 1);
+    if (bound >= 1e18) return SIZE_MAX;
+  }
+  return static_cast<size_t>(bound) + 1;
+}
+
+struct SearchOptions {
+  size_t transpositionBytes = kDefaultTranspositionMB << 20;
+  HeuristicType heuristic = HeuristicType::kMatching;
+  // 0 表示不限制
+  uint64_t timeLimitMs = 0;
+  size_t memoryLimitBytes = 0;
+  bool verbose = true;
+  // 跨关卡/跨运行共享的死锁模式库, 为空时只用本次搜索学到的模式
+  PatternDatabase* patterns = nullptr;
+  // 每展开这么多节点打印一行进度, 0 表示不打印
+  uint64_t progressInterval = 100000;
+  // 编译时定义了 SOKOBAN_PROFILE 才有效: 每多少次调用计一次时
+  uint64_t profileSampleRate = 16;
+  // 外存搜索的临时目录和磁盘用量上限, 0 表示不限制
+  std::string scratchDir = ".";
+  size_t diskLimitBytes = 0;
+};
+
+enum class SearchStatus {
+  kSolved,
+  kNoSolution,
+  kTimeLimit,
+  kMemoryLimit,
+  kDiskLimit
+};
+
+static const char* statusName(SearchStatus status) {
+  switch (status) {
+    case SearchStatus::kSolved: return "solved";
+    case SearchStatus::kNoSolution: return "no_solution";
+    case SearchStatus::kTimeLimit: return "time_limit";
+    case SearchStatus::kMemoryLimit: return "memory_limit";
+    case SearchStatus::kDiskLimit: return "disk_limit";
+  }
+  return "unknown";
+}
+
+struct SearchResult {
+  SearchStatus status = SearchStatus::kNoSolution;
+  std::vector<Push> pushes;
+  std::string moves;
+  uint64_t generateNodes = 0;
+  uint64_t explorNodes = 0;
+  uint64_t deadlockNodes = 0;
+  // 推动之后被冻结检测剪掉的节点
+  uint64_t frozenNodes = 0;
+  // 匹配到死锁模式库被剪掉的节点
+  uint64_t patternNodes = 0;
+  // 有无解的 PI-corral 被剪掉的节点
+  uint64_t corralNodes = 0;
+  uint64_t timeMs = 0;
+  // 搜索数据结构(节点池, 置换表, 开放表)占用内存的峰值
+  size_t peakMemoryBytes = 0;
+  // 解答缓存里取出并重放验证过的解, 没有重新搜索. 这时上面的统计是当初搜索时的
+  bool cached = false;
+
+  bool solved() const { return status == SearchStatus::kSolved; }
+};
+
+// 一行 JSON 的进度, 不画棋盘, 方便在日志里 grep 和画图
+static void printProgress(const SearchResult& result, uint64_t startTime, size_t frontier, size_t closed,
+    int bestH) {
+  uint64_t elapsedMs = (getNowTime() - startTime) / 1000000;
+  printf("progress {\"expanded\": %lu, \"generated\": %lu, \"nodes_per_sec\": %.0f, \"frontier\": %zu, "
+      "\"closed\": %zu, \"memory_mb\": %zu, \"best_h\": %d, \"elapsed_ms\": %lu}\n",
+      result.explorNodes, result.generateNodes, elapsedMs == 0 ? 0.0 : result.explorNodes * 1000.0 / elapsedMs,
+      frontier, closed, result.peakMemoryBytes >> 20, bestH, elapsedMs);
+  fflush(stdout);
+}
+
+static SearchResult astarSearch(Board& board, const SearchOptions& options = SearchOptions()) {
+  uint64_t startTime = getNowTime();
+  SearchResult result;
+  DeadLock dl;
+  dl.generate(board);
+  const Board start(board);
+  Heuristic heuristic(options.heuristic, dl, board);
+  heuristic.reset(board);
+  int rootH = heuristic.value();
+  if (rootH == Heuristic::kDeadlock) return result;
+  board.heuristic = &heuristic;
+  PROFILE_RESET(options.profileSampleRate);
+  PatternDatabase patterns;
+  if (options.patterns != nullptr) patterns.copyFrom(*options.patterns);
+  MacroMoves macros;
+  macros.generate(board, dl);
+  CorralPruner corrals(dl, board);
+
+  NodeArena nodes;
+  nodes.add(SearchNode{ kNoParent, 0, 0, 0, 0, static_cast<uint16_t>(rootH), 0, kNoMacro });
+  BucketQueue<uint32_t> frontier;
+  frontier.push(0, rootH, 0);
+  TranspositionTable visited(options.transpositionBytes, positionBound(board, dl));
+
+  uint32_t current = 0;
+  uint32_t goalNode = kNoParent;
+  std::vector<uint32_t> path;
+  std::vector<Push> pushes;
+  std::vector<Push> macroPushes;
+  // 上一个取出的节点和这一个的 reach, 取出的节点正好是上一个的子节点时增量计算
+  Reach reaches[2];
+  int which = 0;
+  int bestH = rootH;
+  uint64_t nextProgress = options.progressInterval;
+  // 置换表按需扩容, 搜索中定期取样, 结束时再取一次
+  auto sampleMemory = [&] {
+    result.peakMemoryBytes = std::max(result.peakMemoryBytes, nodes.memoryBytes() +
+        visited.memoryBytes() + frontier.memoryBytes());
+  };
   while (!frontier.empty()) {
-    PushPtr push = frontier.pop();
-
-    board.recoverFromData(push->data);
-    ++explorNodes;
-
-    doPush(board, *push);
-    // board.print();
-    // if (visitedZobrist.find(board.zobrist) != visitedZobrist.end()) {
-    //   std::cout << "repeat situation" << std::endl;
-    //   continue;
-    // }
-    // visitedZobrist.insert(board.zobrist);
-
-    DynamicData data;
-    board.extractDynamicData(data);
-    if (visited.find(data) != visited.end()) {
-      continue;
+    if ((result.explorNodes & 1023) == 0) {
+      sampleMemory();
+      if (options.memoryLimitBytes != 0 && result.peakMemoryBytes > options.memoryLimitBytes) {
+        result.status = SearchStatus::kMemoryLimit;
+        break;
+      }
+      if (options.timeLimitMs != 0 && (getNowTime() - startTime) / 1000000 > options.timeLimitMs) {
+        result.status = SearchStatus::kTimeLimit;
+        break;
+      }
+    }
+    uint32_t idx;
+    {
+      PROFILE_SCOPE(kQueue);
+      idx = frontier.pop();
     }
+    bool child = nodes[idx].parent == current && nodes[idx].macro == kNoMacro;
+    moveToNode(board, nodes, macros, current, idx, path);
+    current = idx;
+    ++result.explorNodes;
+
+    const Reach& last = reaches[which];
+    which ^= 1;
+    Reach& reach = reaches[which];
+    if (child) {
+      updateReach(board, last, nodePush(nodes[idx]), reach);
+    } else {
+      calcReachableTiles(board, reach);
+    }
+    bool fresh;
+    {
+      PROFILE_SCOPE(kHash);
+      fresh = visited.insert(board.normalizedZobrist(reach.minReachableSolt), nodes[idx].g);
+    }
+    if (!fresh) continue;
 
-    if (explorNodes % 100000 == 0) {
-      board.print();
-      board.printForIcon();
-      uint64_t endTime = getNowTime();
-      printf("generateNodes: %d, explorNodes: %d, spent time: %lu ms\n", generateNodes, explorNodes, (endTime - startTime) / 1000000);
+    bestH = std::min<int>(bestH, nodes[idx].h);
+    if (options.verbose && options.progressInterval != 0 && result.explorNodes >= nextProgress) {
+      printProgress(result, startTime, frontier.size(), visited.size(), bestH);
+      nextProgress = result.explorNodes + options.progressInterval;
     }
 
     if (checkGameOver(board)) {
+      goalNode = idx;
       break;
     }
 
-    visited.insert(data);
-
-    std::vector<Push> pushes;
-    getPushes(board, pushes);
-    if (pushes.size() == 1) {
-      PushPtr pushPtr(new Push(pushes.front()));
-      frontier.push(pushPtr, 0);
-      // printf("only one push\n");
-    } else {
-    for (auto p : pushes) {
-      ++generateNodes;
-      bool isdead = dl.isDeadSolt(p.boxSolt + p.dir);
-      if (isdead) continue;
-      PushPtr pushPtr(new Push(p));
-      bool istunnel = isTunnels(p, board);
-      // if (istunnel) printf("tunnel, %d, %d\n", p.boxSolt, p.dir);
-      int cost = istunnel ? 0 : costForManhattan(board, p);
-      // int cost = costForManhattan(board, p);
-      frontier.push(pushPtr, cost);
-      // board.print();
-      // printf("push item: %d, %d, %d\n", p.boxSolt, p.dir, cost);
+    pushes.clear();
+    getPushes(board, reach, pushes);
+    bool corral;
+    {
+      PROFILE_SCOPE(kDeadlock);
+      corral = corrals.prune(board, reach, pushes);
     }
+    if (corral) ++result.corralNodes;
+    bool expanded = false;
+    for (const auto& p : pushes) {
+      ++result.generateNodes;
+      if (dl.isDeadSolt(p.boxSolt + p.dir)) continue;
+      doPush(board, p);
+      macroPushes.clear();
+      MacroType macro = macros.extend(board, p, macroPushes);
+      int dest = macroPushes.empty() ? p.boxSolt + p.dir : macroPushes.back().boxSolt + macroPushes.back().dir;
+      bool frozen;
+      bool pattern;
+      {
+        PROFILE_SCOPE(kDeadlock);
+        frozen = dl.isFreezeDeadlock(board, dest);
+        pattern = !frozen && patterns.isDeadlock(board, dest);
+      }
+      int h = heuristic.value();
+      undoPushes(board, macroPushes);
+      undoPush(board, p);
+      if (frozen) {
+        ++result.frozenNodes;
+        continue;
+      }
+      if (pattern) {
+        ++result.patternNodes;
+        continue;
+      }
+      if (h == Heuristic::kDeadlock) {
+        ++result.deadlockNodes;
+        continue;
+      }
+      uint16_t g = nodes[idx].g + 1 + macroPushes.size();
+      uint32_t child = nodes.add(SearchNode{ idx, static_cast<uint16_t>(p.boxSolt), static_cast<int16_t>(p.dir),
+          static_cast<uint16_t>(nodes[idx].depth + 1), g, static_cast<uint16_t>(h),
+          static_cast<uint16_t>(dest), macro });
+      PROFILE_SCOPE(kQueue);
+      frontier.push(child, g + h, g);
+      expanded = true;
     }
+    // 所有子节点都被剪掉说明这个局面无解, 从最后推动的箱子周围学习死锁模式
+    if (!expanded && idx != 0) patterns.learn(board, nodes[idx].destSolt);
   }
+  sampleMemory();
+
+  board.heuristic = nullptr;
+  if (options.patterns != nullptr) options.patterns->merge(patterns);
+  if (goalNode != kNoParent) {
+    result.status = SearchStatus::kSolved;
+    collectPushes(nodes, macros, goalNode, result.pushes);
+    expandToMoves(start, result.pushes, result.moves);
+  }
+  uint64_t endTime = getNowTime();
+  result.timeMs = (endTime - startTime) / 1000000;
+  if (!options.verbose) return result;
+
   board.print();
   board.printForIcon();
-  if (checkGameOver(board)) {
+  if (result.solved()) {
     printf("find best way in Astar search\n");
   } else {
-    printf("not find best way in Astar search\n"); 
+    printf("not find best way in Astar search: %s\n", statusName(result.status));
   }
-  uint64_t endTime = getNowTime();
-  printf("generateNodes: %d, explorNodes: %d, spent time: %lu ms, speed: %lu nodes/s\n", generateNodes, explorNodes, (endTime - startTime) / 1000000, (uint64_t)((double)explorNodes / (endTime - startTime) * 1000000000));
+  printf("generateNodes: %lu, explorNodes: %lu, deadlockNodes: %lu, frozenNodes: %lu, patternNodes: %lu, corralNodes: %lu, spent time: %lu ms, speed: %lu nodes/s\n", result.generateNodes, result.explorNodes, result.deadlockNodes, result.frozenNodes, result.patternNodes, result.corralNodes, result.timeMs, (uint64_t)((double)result.explorNodes / (endTime - startTime) * 1000000000));
+  printf("transposition: %zu/%zu entries, %zu MB, %lu replaced\n", visited.size(), visited.capacity(), visited.memoryBytes() >> 20, visited.replacements());
+  printf("nodes: %u, %zu MB, heuristic augments: %lu\n", nodes.size(), nodes.memoryBytes() >> 20, heuristic.augments());
+  printf("deadlock patterns: %zu, sub-searches: %lu, goal rooms: %zu, PI-corrals: %lu\n", patterns.size(), patterns.searches(), macros.goalRooms(), corrals.corrals());
+  PROFILE_PRINT(stdout);
+  return result;
 }
 
 #endif
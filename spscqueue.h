@@ -0,0 +1,74 @@
+#ifndef WSUN_SOKOBAN_SPSCQUEUE_H
+#define WSUN_SOKOBAN_SPSCQUEUE_H
+
+#include <atomic>
+#include <inttypes.h>
+
+// 单生产者单消费者的无锁队列, 按块分配, 长度不设上限.
+// 生产者写完一个元素后用 release 发布块内计数, 消费者 acquire 读取,
+// 读完的块由消费者释放.
+template <class T>
+class SpscQueue {
+ public:
+  static const uint32_t kChunkSize = 256;
+
+  SpscQueue() {
+    head_ = tail_ = new Chunk;
+    headPos_ = 0;
+  }
+
+  ~SpscQueue() {
+    while (head_ != nullptr) {
+      Chunk* next = head_->next.load(std::memory_order_relaxed);
+      delete head_;
+      head_ = next;
+    }
+  }
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  // 只能由生产者线程调用
+  void push(const T& item) {
+    uint32_t count = tail_->count.load(std::memory_order_relaxed);
+    if (count == kChunkSize) {
+      Chunk* chunk = new Chunk;
+      chunk->items[0] = item;
+      chunk->count.store(1, std::memory_order_relaxed);
+      tail_->next.store(chunk, std::memory_order_release);
+      tail_ = chunk;
+      return;
+    }
+    tail_->items[count] = item;
+    tail_->count.store(count + 1, std::memory_order_release);
+  }
+
+  // 只能由消费者线程调用
+  bool pop(T& item) {
+    if (headPos_ == kChunkSize) {
+      Chunk* next = head_->next.load(std::memory_order_acquire);
+      if (next == nullptr) return false;
+      delete head_;
+      head_ = next;
+      headPos_ = 0;
+    }
+    if (headPos_ == head_->count.load(std::memory_order_acquire)) return false;
+    item = head_->items[headPos_++];
+    return true;
+  }
+
+ private:
+  struct Chunk {
+    T items[kChunkSize];
+    std::atomic<uint32_t> count{0};
+    std::atomic<Chunk*> next{nullptr};
+  };
+
+  // 消费者独占
+  Chunk* head_;
+  uint32_t headPos_;
+  // 生产者独占
+  Chunk* tail_;
+};
+
+#endif
@@ -0,0 +1,67 @@
+// 增量匹配估值测试: 把箱子随机挪到内部格子上(包括死格), 反复进出死局,
+// 大量增广之后增量维护的估值要和整体重算的一致
+
+#include "parser.h"
+#include "solver.h"
+#include <cstdio>
+#include <random>
+
+namespace {
+
+const int kLevels[] = { 1, 3 };
+const int kMoves = 4000000;
+const int kCheckInterval = 997;
+
+int failures = 0;
+
+void shuffleBoxes(const Level& level, int levelIndex) {
+  Board board(level);
+  DeadLock dl;
+  dl.generate(board);
+  Heuristic heuristic(HeuristicType::kMatching, dl, board);
+  heuristic.reset(board);
+
+  const std::vector<int>& solts = board.context->solts;
+  std::mt19937 rng(levelIndex);
+  int deadlocks = 0;
+  int revivals = 0;
+  bool dead = false;
+  for (int i = 1; i <= kMoves; ++i) {
+    int from = board.boxes.begin()[rng() % board.boxes.size()];
+    int to = solts[rng() % solts.size()];
+    if (board.map[to] & SquareType::kBox) continue;
+    board.map[from] ^= SquareType::kBox;
+    board.map[to] |= SquareType::kBox;
+    board.boxes.move(from, to);
+    heuristic.moveBox(board, from, to);
+    bool nowDead = heuristic.value() == Heuristic::kDeadlock;
+    if (nowDead && !dead) ++deadlocks;
+    if (!nowDead && dead) ++revivals;
+    dead = nowDead;
+
+    if (i % kCheckInterval != 0) continue;
+    Heuristic fresh(HeuristicType::kMatching, dl, board);
+    fresh.reset(board);
+    if (fresh.value() != heuristic.value()) {
+      fprintf(stderr, "FAIL level %d move %d: incremental %d, reset %d\n", levelIndex, i,
+          heuristic.value(), fresh.value());
+      ++failures;
+      return;
+    }
+  }
+  if (deadlocks == 0 || revivals == 0 || heuristic.augments() == 0) {
+    fprintf(stderr, "FAIL level %d: %d deadlocks, %d revivals, %lu augments\n", levelIndex,
+        deadlocks, revivals, heuristic.augments());
+    ++failures;
+  }
+}
+
+} // namespace
+
+int main() {
+  LevelArray levels;
+  getAllLevels(levels);
+  for (int level : kLevels) shuffleBoxes(levels[level - 1], level);
+  if (failures == 0) printf("ok\n");
+  return failures == 0 ? 0 : 1;
+}
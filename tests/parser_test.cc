@@ -0,0 +1,144 @@
+// 关卡集读取测试: 求解器处理不了的关卡要报告后跳过, 后面的关卡照常读出
+
+#include "parser.h"
+#include <cstdio>
+#include <sstream>
+#include <string>
+
+namespace {
+
+int failures = 0;
+
+void expect(bool ok, const char* what) {
+  if (!ok) {
+    fprintf(stderr, "FAIL %s\n", what);
+    ++failures;
+  }
+}
+
+// 一行 width 格宽, 里面放 boxes 个箱子和目标的关卡, 用行程编码写
+std::string wideLevel(int width, int boxes, bool player) {
+  std::ostringstream oss;
+  oss << width << "#\n";
+  oss << "#" << (player ? "@" : " ") << width - 3 << " #\n";
+  int rows = (boxes + width - 3) / (width - 2);
+  for (int i = 0; i < rows; ++i) {
+    int count = std::min(boxes - i * (width - 2), width - 2);
+    oss << "#" << count << "*";
+    if (count < width - 2) oss << width - 2 - count << " ";
+    oss << "#\n";
+  }
+  oss << width << "#\n";
+  return oss.str();
+}
+
+// width 格宽, rows 行高, 只有一个箱子的关卡
+std::string tallLevel(int width, int rows) {
+  std::ostringstream oss;
+  oss << width << "#\n";
+  oss << "#@$." << width - 5 << " #\n";
+  for (int i = 0; i < rows - 3; ++i) oss << "#" << width - 2 << " #\n";
+  oss << width << "#\n";
+  return oss.str();
+}
+
+const char kValid[] =
+    "Title: valid\n"
+    "#####\n"
+    "#@$.#\n"
+    "#####\n";
+
+// 先是一个处理不了的关卡, 然后是一个正常关卡; 只能读出后一个
+void expectSkipped(const std::string& bad, const char* what) {
+  std::istringstream in(bad + "\n" + kValid);
+  CollectionReader reader(in);
+  Level level;
+  bool read = reader.next(level);
+  expect(read && level.title == "valid" && level.file == 5 && level.rank == 3, what);
+  expect(!reader.next(level), what);
+}
+
+bool readOne(const std::string& text, Level& level) {
+  std::istringstream in(text);
+  CollectionReader reader(in);
+  return reader.next(level);
+}
+
+SquareType at(const Level& level, int row, int col) {
+  return level.map[row * level.file + col];
+}
+
+// 行程编码, '|' 分行, '-'/'_' 空地
+void testRunLength() {
+  Level level;
+  bool read = readOne("8#|#-@$2_.#|8#\n", level);
+  expect(read && level.file == 8 && level.rank == 3, "run-length size");
+  if (!read) return;
+  expect(at(level, 0, 7) == SquareType::kWall && at(level, 1, 0) == SquareType::kWall, "run-length walls");
+  expect(at(level, 1, 1) == SquareType::kFloor && at(level, 1, 4) == SquareType::kFloor &&
+      at(level, 1, 5) == SquareType::kFloor, "'-' and '_' are floor");
+  expect(at(level, 1, 2) == SquareType::kPlayer && at(level, 1, 3) == SquareType::kBox &&
+      at(level, 1, 6) == SquareType::kGoal, "run-length pieces");
+}
+
+// 标题可以是 "Title:" 行, 关卡前面的注释, 或者 SOK 写在关卡后面的 "Title:"
+void testTitles() {
+  Level level;
+  expect(readOne("; a comment\nTitle: Named\n#####\n#@$.#\n#####\n", level) && level.title == "Named",
+      "Title: line");
+  expect(readOne("Just a name\n\n#####\n#@$.#\n#####\n", level) && level.title == "Just a name",
+      "comment line as title");
+  expect(readOne("#####\n#@$.#\n#####\nTitle: After\n", level) && level.title == "After",
+      "SOK title after the level");
+
+  std::istringstream in("Title: One\n#####\n#@$.#\n#####\n\n; Two\n#####\n#.$@#\n#####\n");
+  CollectionReader reader(in);
+  expect(reader.next(level) && level.title == "One", "first of two titles");
+  expect(reader.next(level) && level.title == "Two", "second of two titles");
+  expect(!reader.next(level), "two levels only");
+}
+
+// 从边上走得到的空地在墙外, 标成 kEmpty; 短行补齐的部分也一样
+void testOutside() {
+  Level level;
+  bool read = readOne("  ####\n###  #\n#@$. #\n#####\n", level);
+  expect(read && level.file == 6 && level.rank == 4, "outside size");
+  if (!read) return;
+  expect(at(level, 0, 0) == SquareType::kEmpty && at(level, 0, 1) == SquareType::kEmpty, "leading blanks");
+  expect(at(level, 3, 5) == SquareType::kEmpty, "short row padding");
+  expect(at(level, 1, 3) == SquareType::kFloor && at(level, 2, 4) == SquareType::kFloor, "inside floor");
+}
+
+} // namespace
+
+int main() {
+  {
+    std::istringstream in(kValid);
+    CollectionReader reader(in);
+    Level level;
+    expect(reader.next(level) && levelError(level) == nullptr, "valid level");
+  }
+  {
+    std::istringstream in(wideLevel(63, 1, true));
+    CollectionReader reader(in);
+    Level level;
+    expect(reader.next(level) && level.file == 63, "63 squares wide");
+  }
+  expectSkipped(wideLevel(64, 1, true), "64 squares wide");
+  expectSkipped(wideLevel(40, 65, true), "65 boxes");
+  expectSkipped(wideLevel(10, 1, false), "no player");
+  expectSkipped(tallLevel(40, 52), "too many squares");
+  expectSkipped("#####\n#@$.#\n# $ #\n#####\n", "more boxes than goals");
+  expectSkipped("#####\n#@ .#\n#####\n", "no boxes");
+  expectSkipped("40#\n#38*#\n#26*.11 #\n#@37 #\n40#\n", "65 goals");
+  {
+    // 墙外的箱子封内部时去掉, 不算进箱子数
+    Level level;
+    expect(readOne("#####  $\n#@$.#\n#####\n", level) && levelError(level) == nullptr, "box outside the walls");
+  }
+  testRunLength();
+  testTitles();
+  testOutside();
+  if (failures == 0) printf("ok\n");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,50 @@
+// 已知最优推动数的关卡回归测试: 可采纳估值下 A* 和 HDA* 必须给出最优解.
+// 宏推动或剪枝丢掉了最优解时推动数会变多
+
+#include "parser.h"
+#include "solver.h"
+#include "parallel.h"
+#include <cstdio>
+
+namespace {
+
+struct Case {
+  int level;
+  size_t pushes;
+};
+
+// XSokoban 关卡的推动最优解长度
+const Case kCases[] = {
+  { 1, 97 },
+  { 2, 131 },
+};
+
+int failures = 0;
+
+void expectPushes(const char* mode, const Case& c, const SearchResult& result) {
+  if (!result.solved() || result.pushes.size() != c.pushes) {
+    fprintf(stderr, "FAIL %s level %d: %s, %zu pushes, want %zu\n", mode, c.level,
+        statusName(result.status), result.pushes.size(), c.pushes);
+    ++failures;
+  }
+}
+
+} // namespace
+
+int main() {
+  LevelArray levels;
+  getAllLevels(levels);
+  SearchOptions options;
+  options.verbose = false;
+  options.progressInterval = 0;
+  for (const auto& c : kCases) {
+    Board astar(levels[c.level - 1]);
+    expectPushes("astar", c, astarSearch(astar, options));
+    Board single(levels[c.level - 1]);
+    expectPushes("hda*-j1", c, parallelAstarSearch(single, 1, options));
+    Board parallel(levels[c.level - 1]);
+    expectPushes("hda*-j2", c, parallelAstarSearch(parallel, 2, options));
+  }
+  if (failures == 0) printf("ok\n");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+#ifndef WSUN_SOKOBAN_THREADPOOL_H
+#define WSUN_SOKOBAN_THREADPOOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 每个工作线程一个任务队列, 自己从队尾取, 空了就从别的线程队首偷.
+// 关卡之间耗时差别很大, 偷任务可以让先做完的线程接着分担剩下的关卡.
+class WorkStealingPool {
+ public:
+  using Task = std::function<void()>;
+
+  explicit WorkStealingPool(int threads)
+    : queues_(threads > 0 ? threads : 1),
+      pending_(0),
+      next_(0),
+      stop_(false) {
+    for (size_t i = 0; i < queues_.size(); ++i) {
+      queues_[i].reset(new Queue);
+    }
+    for (size_t i = 0; i < queues_.size(); ++i) {
+      workers_.emplace_back(&WorkStealingPool::run, this, i);
+    }
+  }
+
+  ~WorkStealingPool() {
+    wait();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wakeup_.notify_all();
+    for (auto& worker : workers_) worker.join();
+  }
+
+  int size() const { return static_cast<int>(queues_.size()); }
+
+  void submit(Task task) {
+    Queue& q = *queues_[next_++ % queues_.size()];
+    {
+      std::lock_guard<std::mutex> lock(q.mutex);
+      q.tasks.push_back(std::move(task));
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++pending_;
+    }
+    wakeup_.notify_one();
+  }
+
+  // 阻塞到已提交的任务全部执行完
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return pending_ == 0; });
+  }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  bool popLocal(size_t idx, Task& task) {
+    Queue& q = *queues_[idx];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty()) return false;
+    task = std::move(q.tasks.back());
+    q.tasks.pop_back();
+    return true;
+  }
+
+  bool steal(size_t idx, Task& task) {
+    for (size_t i = 1; i < queues_.size(); ++i) {
+      Queue& q = *queues_[(idx + i) % queues_.size()];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (q.tasks.empty()) continue;
+      task = std::move(q.tasks.front());
+      q.tasks.pop_front();
+      return true;
+    }
+    return false;
+  }
+
+  void run(size_t idx) {
+    for (;;) {
+      Task task;
+      if (popLocal(idx, task) || steal(idx, task)) {
+        task();
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_ == 0) done_.notify_all();
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (stop_) return;
+      // pending_ 里还包括正在别的线程上执行的任务, 队列可能已经空了, 所以只短暂等待后再去偷
+      wakeup_.wait_for(lock, std::chrono::milliseconds(10));
+    }
+  }
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  std::condition_variable done_;
+  int pending_;
+  std::atomic<size_t> next_;
+  bool stop_;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "transposition.h"
+#include <algorithm>
+
+TranspositionTable::TranspositionTable(size_t bytes, size_t positions)
+  : generation_(1),
+    size_(0),
+    replacements_(0) {
+  // 槽位数上限取不超过内存上限的2的幂, 至少一个探测窗口. 局面数有上限的小关卡留一倍余量就够了
+  maxSlots_ = kBucketSize;
+  while (maxSlots_ * 2 * sizeof(Entry) <= bytes && maxSlots_ / 2 < positions) maxSlots_ *= 2;
+  size_t count = std::min(maxSlots_, kInitialSlots);
+  entries_.resize(count);
+  mask_ = count - 1;
+}
+
+// 翻倍后把当前代的条目重新放一遍. 原来一个窗口里的条目只会落到新表里对应的两个窗口,
+// 不会挤满, 翻倍不丢条目
+void TranspositionTable::grow() {
+  std::vector<Entry> old(entries_.size() * 2);
+  old.swap(entries_);
+  mask_ = entries_.size() - 1;
+  for (const Entry& e : old) {
+    if (!used(e)) continue;
+    Entry* slot = &entries_[bucketOf(e.key)];
+    while (used(*slot)) ++slot;
+    *slot = e;
+  }
+}
+
+size_t TranspositionTable::bucketOf(const Zobrist& key) const {
+  return key.Hash() & mask_ & ~static_cast<size_t>(kBucketSize - 1);
+}
+
+bool TranspositionTable::insert(const Zobrist& key, int g, uint32_t value) {
+  Entry* bucket = &entries_[bucketOf(key)];
+  Entry* victim = nullptr;
+  for (int i = 0; i < kBucketSize; ++i) {
+    Entry& e = bucket[i];
+    if (!used(e)) {
+      if (victim == nullptr || used(*victim)) victim = &e;
+      continue;
+    }
+    if (e.key == key) {
+      if (g >= e.g) return false;
+      e.g = g;
+      e.value = value;
+      return true;
+    }
+    if (victim == nullptr || (used(*victim) && e.g > victim->g)) victim = &e;
+  }
+
+  if (used(*victim)) {
+    // 还没到内存上限就翻倍, 不替换. 太空的表窗口满了只是运气不好, 照常替换
+    if (entries_.size() < maxSlots_ && size_ * 8 >= entries_.size()) {
+      grow();
+      return insert(key, g, value);
+    }
+    ++replacements_;
+  } else {
+    ++size_;
+  }
+  victim->key = key;
+  victim->g = g;
+  victim->value = value;
+  victim->generation = generation_;
+  return true;
+}
+
+bool TranspositionTable::lookup(const Zobrist& key, int* g, uint32_t* value) const {
+  const Entry* bucket = &entries_[bucketOf(key)];
+  for (int i = 0; i < kBucketSize; ++i) {
+    const Entry& e = bucket[i];
+    if (used(e) && e.key == key) {
+      if (g != nullptr) *g = e.g;
+      if (value != nullptr) *value = e.value;
+      return true;
+    }
+  }
+  return false;
+}
+
+void TranspositionTable::clear() {
+  // 代号绕回0时旧条目可能被认成当前代, 只有这时才真正清空
+  if (++generation_ == 0) {
+    std::fill(entries_.begin(), entries_.end(), Entry());
+    generation_ = 1;
+  }
+  size_ = 0;
+  replacements_ = 0;
+}
@@ -0,0 +1,57 @@
+#ifndef WSUN_SOKOBAN_TRANSPOSITION_H_
+#define WSUN_SOKOBAN_TRANSPOSITION_H_
+
+#include "zobrist.h"
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// 以 Zobrist 为键的开放寻址置换表.
+// 每个键只在 kBucketSize 个连续槽位内探测, 探测窗口满时替换其中 g 最大的条目:
+// 离根越近的局面覆盖的子树越大, 优先保留.
+// 表从小开始, 条目超过 1/8 以后探测窗口一满就翻倍, 直到 bytes 的上限;
+// 小关卡用不着一开始就占满内存.
+// 条目带代号, 代号不等于表的当前代号就算空槽, clear() 只需把代号加一
+class TranspositionTable {
+ public:
+  static const int kBucketSize = 4;
+  static constexpr size_t kInitialSlots = 1 << 16;
+
+  // 槽位数不超过 bytes 能放下的数量, 也不超过容纳 positions 个局面所需
+  explicit TranspositionTable(size_t bytes, size_t positions = SIZE_MAX);
+
+  // 返回 true 表示该局面是第一次出现或者以更小的 g 到达, 调用方应继续展开.
+  // value 由调用方自行解释, 比如双向搜索里记录节点下标
+  bool insert(const Zobrist& key, int g, uint32_t value = 0);
+  bool lookup(const Zobrist& key, int* g, uint32_t* value = nullptr) const;
+  void clear();
+
+  size_t capacity() const { return entries_.size(); }
+  size_t size() const { return size_; }
+  size_t memoryBytes() const { return entries_.size() * sizeof(Entry); }
+  uint64_t replacements() const { return replacements_; }
+
+ private:
+  struct Entry {
+    Zobrist key;
+    int32_t g;
+    uint32_t value;
+    uint32_t generation;
+
+    Entry() : g(0), value(0), generation(0) {}
+  };
+
+  size_t bucketOf(const Zobrist& key) const;
+  bool used(const Entry& e) const { return e.generation == generation_; }
+  void grow();
+
+  std::vector<Entry> entries_;
+  size_t mask_;
+  size_t maxSlots_;
+  uint32_t generation_;
+  size_t size_;
+  uint64_t replacements_;
+};
+
+#endif // #ifndef WSUN_SOKOBAN_TRANSPOSITION_H_
@@ -2,6 +2,7 @@
 #define WSUN_SOKOBAN_TYPES_H
 
 #include <inttypes.h>
+#include <string>
 #include <vector>
 
 enum SquareType : unsigned {
@@ -21,6 +22,8 @@ struct Level {
   int file;
   int rank;
   Map map;
+  // 关卡集里的标题, 没有时为空
+  std::string title;
 };
 
 using LevelArray = std::vector<Level>;
@@ -66,3 +66,7 @@ bool Zobrist::operator!=(const Zobrist& rhs) const {
 bool Zobrist::operator<(const Zobrist& rhs) const {
   return keys < rhs.keys;
 }
+
+uint64_t Zobrist::Hash() const {
+  return (static_cast<uint64_t>(keys[1]) << 32) | keys[0];
+}
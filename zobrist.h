@@ -22,11 +22,14 @@ public:
 	Zobrist();
 	Zobrist(RC4& rc4);
   Zobrist(const Zobrist&);
+  Zobrist& operator=(const Zobrist&) = default;
 	void Reset();
 	void XOR(const Zobrist& rhs);
   bool operator==(const Zobrist& rhs) const;
   bool operator!=(const Zobrist& rhs) const;
   bool operator<(const Zobrist& rhs) const;
+  // 取前64位作为散列表下标
+  uint64_t Hash() const;
 
   using Array = std::array<uint32_t, 4>;
 private: